@@ -1,106 +1,828 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 #include "audio.h"
+#include "platform.h"
+#include "log.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <stdatomic.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <mmsystem.h>
 #pragma comment(lib, "winmm.lib")
+#else
+#include <dirent.h>
+#include <sys/stat.h>
 #endif
 
 // Audio state
-static ma_engine engine;
+static ma_device device;
+static ma_context null_context;         // Only used by init_audio_headless()
+static int use_null_context = 0;
+static int audio_disabled = 0;          // Headless without a null backend: no output at all
+static ma_encoder offline_encoder;      // Only used by init_audio_offline()
+static int offline_mode = 0;
+static unsigned long long offline_frames_written = 0;
 static int audio_initialized = 0;
 static int use_miniaudio = 0;
 static int audio_muted = 0;
+static volatile float master_volume = 1.0f;
+static ma_uint32 output_sample_rate = 48000;
+
+// Voice pools - voices are preallocated and only ever touched by the
+// device callback. Other threads talk to it through the event queue below.
+#define MAX_SYNTH_VOICES 32
+#define MAX_SAMPLE_VOICES 32
+#define AUDIO_EVENT_QUEUE 256           // Must be a power of two
+#define SYNTH_ATTACK_SEC 0.005f         // Short ramps so notes don't click
+#define SYNTH_RELEASE_SEC 0.020f
+#define SYNTH_VOICE_GAIN 0.2f           // Headroom for chords before clipping
+#define OFFLINE_RENDER_BLOCK 1024       // Frames mixed per encoder write
+
+// wave_type values used by PLAY_FREQUENCY / SET_KEY_MODE
+enum { WAVE_SINE = 0, WAVE_SQUARE = 1, WAVE_TRIANGLE = 2, WAVE_SAWTOOTH = 3 };
+
+typedef struct {
+    int active;
+    int wave_type;
+    float phase;                // 0..1 through the current cycle
+    float phase_step;           // Cycles advanced per output frame
+    float gain;                 // Current envelope level
+    ma_uint64 sustain_frames;   // Frames left before the release ramp starts
+    ma_uint32 started;          // Start order, used to steal the oldest voice
+    int note_id;                // Held note this voice belongs to, -1 for timed tones
+} SynthVoice;
+
+// sustain_frames value for notes that play until note_off()
+#define SYNTH_SUSTAIN_HELD ((ma_uint64)-1)
+
+// Plays one resident sound bank entry; just a cursor into the shared PCM
+typedef struct {
+    int active;
+    int sound_id;
+    ma_uint64 cursor;
+    ma_uint32 started;
+} SampleVoice;
+
+enum { AUDIO_EVENT_NOTE, AUDIO_EVENT_NOTE_OFF, AUDIO_EVENT_SAMPLE, AUDIO_EVENT_STOP_ALL };
+
+typedef struct {
+    int type;
+    int note_id;
+    int wave_type;
+    int sound_id;
+    float frequency;
+    ma_uint64 frames;
+} AudioEvent;
+
+static SynthVoice synth_voices[MAX_SYNTH_VOICES];
+static SampleVoice sample_voices[MAX_SAMPLE_VOICES];
+static ma_uint32 voice_start_counter = 0;
+static float synth_attack_step = 0.0f;
+static float synth_release_step = 0.0f;
+
+// Single-producer (the caller of play_*) / single-consumer (device callback)
+static AudioEvent audio_events[AUDIO_EVENT_QUEUE];
+static atomic_uint audio_event_head;
+static atomic_uint audio_event_tail;
 
 // WAV file registry
+// IDs are assigned in a fixed order: each folder's files sorted case-insensitively,
+// then its subfolders (so sounds/ keeps IDs 0.. and alphabet/ follows).
 #define MAX_SOUNDS 256
-static char sound_registry[MAX_SOUNDS][256];
+#define MAX_SOUND_DEPTH 4
+#define SOUND_INDEX_PATH "sounds/.sound_index"
+
+typedef struct {
+    char name[256];             // Path relative to sounds/, '/' separated
+    ma_uint64 size;
+    ma_uint64 mtime;
+    ma_uint32 sample_rate;      // Native rate, 0 if the file couldn't be probed
+    ma_uint64 frames;           // Native length in PCM frames
+} SoundInfo;
+
+static SoundInfo sound_registry[MAX_SOUNDS];
 static int num_registered_sounds = 0;
 
-void init_audio() {
+// sounds/alphabet/A..Z resolved to registry IDs once after scanning, -1 = missing
+#define LETTER_SOUND_DIR "alphabet/"
+static int letter_sound_ids[26];
+
+// Sound bank: every registered file decoded once at startup to interleaved
+// stereo f32 at the device sample rate. Entries are filled in by the loader
+// threads and are read-only once their ready flag is set.
+#define MAX_BANK_LOADERS 8
+
+typedef struct {
+    float *pcm;
+    ma_uint64 frames;
+} SoundBankEntry;
+
+static SoundBankEntry sound_bank[MAX_SOUNDS];
+static atomic_int sound_ready[MAX_SOUNDS];      // 1 = decoded, 2 = failed
+static atomic_int bank_next_job;
+static atomic_int bank_jobs_left;
+static atomic_int bank_cancel;
+static atomic_size_t bank_bytes;
+static atomic_int bank_loaded;
+static platform_thread *bank_loaders[MAX_BANK_LOADERS];
+static int num_bank_loaders = 0;
+static uint64_t bank_start_ns = 0;
+
+static void start_sound_bank_loaders(void);
+static void index_letter_sounds(void);
+static void free_sound_bank(void);
+
+static int audio_push_event(const AudioEvent *event) {
+    unsigned head = atomic_load_explicit(&audio_event_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&audio_event_tail, memory_order_acquire);
+    if (head - tail == AUDIO_EVENT_QUEUE) return 0;
+    audio_events[head & (AUDIO_EVENT_QUEUE - 1)] = *event;
+    atomic_store_explicit(&audio_event_head, head + 1, memory_order_release);
+    return 1;
+}
+
+static void synth_start_voice(const AudioEvent *event) {
+    SynthVoice *voice = NULL;
+    for (int i = 0; i < MAX_SYNTH_VOICES; i++) {
+        if (!synth_voices[i].active) {
+            voice = &synth_voices[i];
+            break;
+        }
+    }
+    if (!voice) {
+        // Pool exhausted - steal the oldest voice
+        voice = &synth_voices[0];
+        for (int i = 1; i < MAX_SYNTH_VOICES; i++) {
+            if (synth_voices[i].started < voice->started) voice = &synth_voices[i];
+        }
+    }
+
+    voice->active = 1;
+    voice->wave_type = event->wave_type;
+    voice->phase = 0.0f;
+    voice->phase_step = event->frequency / (float)output_sample_rate;
+    voice->gain = 0.0f;
+    voice->sustain_frames = event->frames;
+    voice->started = voice_start_counter++;
+    voice->note_id = event->note_id;
+}
+
+static void sample_start_voice(const AudioEvent *event) {
+    SampleVoice *voice = NULL;
+    for (int i = 0; i < MAX_SAMPLE_VOICES; i++) {
+        if (!sample_voices[i].active) {
+            voice = &sample_voices[i];
+            break;
+        }
+    }
+    if (!voice) {
+        voice = &sample_voices[0];
+        for (int i = 1; i < MAX_SAMPLE_VOICES; i++) {
+            if (sample_voices[i].started < voice->started) voice = &sample_voices[i];
+        }
+    }
+
+    voice->active = 1;
+    voice->sound_id = event->sound_id;
+    voice->cursor = 0;
+    voice->started = voice_start_counter++;
+}
+
+static void audio_drain_events(void) {
+    unsigned tail = atomic_load_explicit(&audio_event_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&audio_event_head, memory_order_acquire);
+    while (tail != head) {
+        const AudioEvent *event = &audio_events[tail & (AUDIO_EVENT_QUEUE - 1)];
+        if (event->type == AUDIO_EVENT_NOTE) {
+            synth_start_voice(event);
+        } else if (event->type == AUDIO_EVENT_NOTE_OFF) {
+            for (int i = 0; i < MAX_SYNTH_VOICES; i++) {
+                if (synth_voices[i].active && synth_voices[i].note_id == event->note_id) {
+                    synth_voices[i].sustain_frames = 0;
+                    synth_voices[i].note_id = -1;
+                }
+            }
+        } else if (event->type == AUDIO_EVENT_SAMPLE) {
+            sample_start_voice(event);
+        } else if (event->type == AUDIO_EVENT_STOP_ALL) {
+            for (int i = 0; i < MAX_SYNTH_VOICES; i++) synth_voices[i].sustain_frames = 0;
+            for (int i = 0; i < MAX_SAMPLE_VOICES; i++) sample_voices[i].active = 0;
+        }
+        tail++;
+    }
+    atomic_store_explicit(&audio_event_tail, tail, memory_order_release);
+}
+
+static float synth_oscillator(int wave_type, float phase) {
+    switch (wave_type) {
+        case WAVE_SQUARE:   return phase < 0.5f ? 1.0f : -1.0f;
+        case WAVE_TRIANGLE: return 1.0f - 4.0f * fabsf(phase - 0.5f);
+        case WAVE_SAWTOOTH: return 2.0f * phase - 1.0f;
+        default:            return sinf(6.28318530718f * phase);
+    }
+}
+
+// Adds every active voice into an interleaved stereo buffer
+static void synth_mix(float *out, ma_uint32 frame_count) {
+    for (int v = 0; v < MAX_SYNTH_VOICES; v++) {
+        SynthVoice *voice = &synth_voices[v];
+        if (!voice->active) continue;
+
+        for (ma_uint32 i = 0; i < frame_count; i++) {
+            if (voice->sustain_frames > 0) {
+                if (voice->sustain_frames != SYNTH_SUSTAIN_HELD) voice->sustain_frames--;
+                voice->gain += synth_attack_step;
+                if (voice->gain > 1.0f) voice->gain = 1.0f;
+            } else {
+                voice->gain -= synth_release_step;
+                if (voice->gain <= 0.0f) {
+                    voice->active = 0;
+                    break;
+                }
+            }
+
+            float sample = synth_oscillator(voice->wave_type, voice->phase) * voice->gain * SYNTH_VOICE_GAIN;
+            out[i * 2 + 0] += sample;
+            out[i * 2 + 1] += sample;
+
+            voice->phase += voice->phase_step;
+            if (voice->phase >= 1.0f) voice->phase -= 1.0f;
+        }
+    }
+}
+
+// Adds every playing bank sample into an interleaved stereo buffer
+static void sample_mix(float *out, ma_uint32 frame_count) {
+    for (int v = 0; v < MAX_SAMPLE_VOICES; v++) {
+        SampleVoice *voice = &sample_voices[v];
+        if (!voice->active) continue;
+
+        const SoundBankEntry *entry = &sound_bank[voice->sound_id];
+        ma_uint64 remaining = entry->frames - voice->cursor;
+        ma_uint32 count = remaining < frame_count ? (ma_uint32)remaining : frame_count;
+        const float *src = entry->pcm + voice->cursor * 2;
+
+        for (ma_uint32 i = 0; i < count * 2; i++) {
+            out[i] += src[i];
+        }
+
+        voice->cursor += count;
+        if (voice->cursor >= entry->frames) voice->active = 0;
+    }
+}
+
+// The master bus: bank samples plus synth voices, added into a silenced
+// buffer. Called from the device callback, or by audio_offline_render().
+static void audio_mix(float *out, ma_uint32 frameCount) {
+    audio_drain_events();
+    sample_mix(out, frameCount);
+    synth_mix(out, frameCount);
+
+    float volume = master_volume;
+    for (ma_uint32 i = 0; i < frameCount * 2; i++) {
+        float sample = out[i] * volume;
+        if (sample > 1.0f) sample = 1.0f;
+        if (sample < -1.0f) sample = -1.0f;
+        out[i] = sample;
+    }
+}
+
+static TRACE_THREAD_LOCAL int device_thread_named = 0;
+
+// Device callback. Runs on miniaudio's audio thread, so nothing in here may
+// block, print or allocate. The device hands us a silenced buffer.
+static void audio_data_callback(ma_device *pDevice, void *pOutput, const void *pInput, ma_uint32 frameCount) {
+    (void)pDevice;
+    (void)pInput;
+    if (trace_on) {
+        // miniaudio's thread, never started by us: name it on first use
+        if (!device_thread_named) {
+            trace_thread_name("audio device");
+            device_thread_named = 1;
+        }
+        uint64_t start = platform_time_ns();
+        audio_mix((float *)pOutput, frameCount);
+        trace_zone("audio callback", start, platform_time_ns());
+    } else {
+        audio_mix((float *)pOutput, frameCount);
+    }
+}
+
+static void init_audio_backend(int null_backend) {
     if (audio_initialized) return;
     
     printf("Initializing Enhanced Dual-Audio System...\n");
     
-    // Try miniaudio first
-    ma_engine_config engineConfig = ma_engine_config_init();
-    ma_result result = ma_engine_init(&engineConfig, &engine);
+    // The null backend pulls from our callback on a timer, so the mixer and
+    // sound bank behave exactly as with a sound card, just silently
+    ma_context *context = NULL;
+    if (null_backend) {
+        ma_backend backends[] = { ma_backend_null };
+        ma_result result = ma_context_init(backends, 1, NULL, &null_context);
+        if (result != MA_SUCCESS) {
+            // Never fall back to a real device: headless runs must stay silent
+            printf("Null audio backend failed (error: %d), running with audio disabled\n", result);
+            audio_disabled = 1;
+            audio_initialized = 1;
+            return;
+        }
+        use_null_context = 1;
+        context = &null_context;
+    }
+    
+    // Try miniaudio first: one device, everything is mixed in our callback
+    ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
+    deviceConfig.playback.format = ma_format_f32;
+    deviceConfig.playback.channels = 2;
+    deviceConfig.dataCallback = audio_data_callback;
+    ma_result result = ma_device_init(context, &deviceConfig, &device);
+    
+    if (result == MA_SUCCESS) {
+        output_sample_rate = device.sampleRate;
+        synth_attack_step = 1.0f / (SYNTH_ATTACK_SEC * output_sample_rate);
+        synth_release_step = 1.0f / (SYNTH_RELEASE_SEC * output_sample_rate);
+
+        result = ma_device_start(&device);
+        if (result != MA_SUCCESS) {
+            ma_device_uninit(&device);
+        }
+    }
     
     if (result == MA_SUCCESS) {
         use_miniaudio = 1;
-        printf("Miniaudio engine initialized\n");
+        printf("Miniaudio device initialized (%u Hz, %d synth voices%s)\n", output_sample_rate, MAX_SYNTH_VOICES,
+               use_null_context ? ", null backend" : "");
+    } else if (use_null_context) {
+        ma_context_uninit(&null_context);
+        use_null_context = 0;
+        printf("Null audio device failed (error: %d), running with audio disabled\n", result);
+        audio_disabled = 1;
+        audio_initialized = 1;
+        return;
     } else {
         use_miniaudio = 0;
         printf("Miniaudio failed (error: %d), using Windows Beep fallback\n", result);
     }
     
-    // Scan for WAV files
+    // Scan for WAV files; decoding them into the resident bank happens in
+    // the background so the window and guest can start right away
     scan_sound_files();
+    if (use_miniaudio) {
+        start_sound_bank_loaders();
+    }
     
     audio_initialized = 1;
     
     // Test audio system
     printf("Testing audio system...\n");
-    printf("Testing Windows Beep...\n");
-#ifdef _WIN32
-    Beep(440, 300);
-#endif
+    play_frequency(440, 0.3f);
     printf("   Audio test complete\n");
     
     printf("Enhanced Dual-Audio System Ready!\n");
-    printf("   - Windows Beep: Always available\n");
+    printf("   - Synth: %s\n", use_miniaudio ? " Sine/Square/Triangle/Sawtooth" : " Windows Beep fallback");
     printf("   - Miniaudio: %s\n", use_miniaudio ? " Available" : " Fallback mode");
     printf("   - WAV files: %d found\n", num_registered_sounds);
 }
 
-void scan_sound_files() {
+void init_audio() {
+    init_audio_backend(0);
+}
+
+void init_audio_headless() {
+    init_audio_backend(1);
+}
+
+// No device at all: the caller advances the sample clock with
+// audio_offline_render() and the master bus goes to a 16-bit WAV file.
+// The whole sound bank is decoded up front so every run mixes the same data.
+int init_audio_offline(const char *wav_path, unsigned sample_rate) {
+    if (audio_initialized) return 0;
+    
+    printf("Initializing offline audio render to %s (%u Hz)...\n", wav_path, sample_rate);
+    
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, sample_rate);
+    ma_result result = ma_encoder_init_file(wav_path, &config, &offline_encoder);
+    if (result != MA_SUCCESS) {
+        printf("Could not create %s (error: %d)\n", wav_path, result);
+        return 0;
+    }
+    
+    output_sample_rate = sample_rate;
+    synth_attack_step = 1.0f / (SYNTH_ATTACK_SEC * output_sample_rate);
+    synth_release_step = 1.0f / (SYNTH_RELEASE_SEC * output_sample_rate);
+    offline_mode = 1;
+    use_miniaudio = 1;
+    
+    scan_sound_files();
+    start_sound_bank_loaders();
+    wait_for_sound_bank();
+    
+    audio_initialized = 1;
+    printf("Offline audio ready (%d sounds in bank)\n", atomic_load(&bank_loaded));
+    return 1;
+}
+
+void audio_offline_render(unsigned long long frames) {
+    if (!offline_mode) return;
+    
+    float mix[OFFLINE_RENDER_BLOCK * 2];
+    ma_int16 pcm[OFFLINE_RENDER_BLOCK * 2];
+    while (frames > 0) {
+        ma_uint32 count = frames < OFFLINE_RENDER_BLOCK ? (ma_uint32)frames : OFFLINE_RENDER_BLOCK;
+        memset(mix, 0, count * 2 * sizeof(float));
+        audio_mix(mix, count);
+        ma_pcm_f32_to_s16(pcm, mix, count * 2, ma_dither_mode_none);
+        ma_encoder_write_pcm_frames(&offline_encoder, pcm, count, NULL);
+        offline_frames_written += count;
+        frames -= count;
+    }
+}
+
+void audio_mix_frames(float *out, unsigned frames) {
+    if (!offline_mode) return;
+    audio_mix(out, frames);
+}
+
+unsigned long long audio_offline_frames(void) {
+    return offline_frames_written;
+}
+
+void audio_kill_voices(void) {
+    if (!offline_mode) return;
+    audio_drain_events();
+    for (int i = 0; i < MAX_SYNTH_VOICES; i++) synth_voices[i].active = 0;
+    for (int i = 0; i < MAX_SAMPLE_VOICES; i++) sample_voices[i].active = 0;
+}
+
+int audio_voices_active(void) {
+    int active = 0;
+    for (int i = 0; i < MAX_SYNTH_VOICES; i++) active += synth_voices[i].active;
+    for (int i = 0; i < MAX_SAMPLE_VOICES; i++) active += sample_voices[i].active;
+    return active;
+}
+
+// ---- Sound directory index ----
+
+typedef struct {
+    char name[256];
+    int is_dir;
+    ma_uint64 size;
+    ma_uint64 mtime;
+} DirEntry;
+
+static int is_audio_file(const char *name) {
+    const char *ext = strrchr(name, '.');
+    if (!ext) return 0;
+    char lower[8];
+    int n = 0;
+    for (ext++; *ext && n < 7; ext++) lower[n++] = (char)((*ext >= 'A' && *ext <= 'Z') ? *ext + 32 : *ext);
+    lower[n] = 0;
+    return strcmp(lower, "wav") == 0 || strcmp(lower, "flac") == 0 || strcmp(lower, "mp3") == 0;
+}
+
+static int compare_dir_entries(const void *a, const void *b) {
+    const DirEntry *x = (const DirEntry *)a;
+    const DirEntry *y = (const DirEntry *)b;
+    if (x->is_dir != y->is_dir) return x->is_dir - y->is_dir;   // Files first
+    for (int i = 0;; i++) {
+        int cx = (unsigned char)x->name[i];
+        int cy = (unsigned char)y->name[i];
+        if (cx >= 'A' && cx <= 'Z') cx += 32;
+        if (cy >= 'A' && cy <= 'Z') cy += 32;
+        if (cx != cy || cx == 0) return cx != cy ? cx - cy : strcmp(x->name, y->name);
+    }
+}
+
+// Lists one directory (no "." entries), returns the entry count
+static int list_directory(const char *dir, DirEntry *entries, int max_entries) {
+    int count = 0;
 #ifdef _WIN32
+    char pattern[512];
     WIN32_FIND_DATA findFileData;
-    HANDLE hFind;
-    
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+    HANDLE hFind = FindFirstFile(pattern, &findFileData);
+    if (hFind == INVALID_HANDLE_VALUE) return 0;
+    do {
+        if (findFileData.cFileName[0] == '.') continue;
+        DirEntry *entry = &entries[count];
+        if (strlen(findFileData.cFileName) >= sizeof(entry->name)) continue;
+        snprintf(entry->name, sizeof(entry->name), "%s", findFileData.cFileName);
+        entry->is_dir = (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        entry->size = ((ma_uint64)findFileData.nFileSizeHigh << 32) | findFileData.nFileSizeLow;
+        entry->mtime = ((ma_uint64)findFileData.ftLastWriteTime.dwHighDateTime << 32)
+                     | findFileData.ftLastWriteTime.dwLowDateTime;
+        count++;
+    } while (count < max_entries && FindNextFile(hFind, &findFileData) != 0);
+    FindClose(hFind);
+#else
+    DIR *handle = opendir(dir);
+    if (!handle) return 0;
+    struct dirent *de;
+    while (count < max_entries && (de = readdir(handle)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char path[512];
+        struct stat st;
+        int length = snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (length < 0 || length >= (int)sizeof(path) || stat(path, &st) != 0) continue;
+        DirEntry *entry = &entries[count];
+        snprintf(entry->name, sizeof(entry->name), "%s", de->d_name);
+        entry->is_dir = S_ISDIR(st.st_mode);
+        entry->size = (ma_uint64)st.st_size;
+        entry->mtime = (ma_uint64)st.st_mtime;
+        count++;
+    }
+    closedir(handle);
+#endif
+    qsort(entries, count, sizeof(DirEntry), compare_dir_entries);
+    return count;
+}
+
+// prefix is the path below sounds/ ("" for the top level)
+static void scan_sound_directory(const char *prefix, int depth) {
+    char dir[512];
+    if (prefix[0]) {
+        snprintf(dir, sizeof(dir), "sounds/%s", prefix);
+    } else {
+        snprintf(dir, sizeof(dir), "sounds");
+    }
+
+    DirEntry *entries = (DirEntry *)malloc(sizeof(DirEntry) * MAX_SOUNDS);
+    if (!entries) return;
+    int count = list_directory(dir, entries, MAX_SOUNDS);
+
+    for (int i = 0; i < count && num_registered_sounds < MAX_SOUNDS; i++) {
+        // Same size as SoundInfo.name; a cut-off path would never load
+        char relative[256];
+        int length;
+        if (prefix[0]) {
+            length = snprintf(relative, sizeof(relative), "%s/%s", prefix, entries[i].name);
+        } else {
+            length = snprintf(relative, sizeof(relative), "%s", entries[i].name);
+        }
+        if (length < 0 || length >= (int)sizeof(relative)) {
+            LOG(LOG_AUDIO, LOG_WARN, "   Skipping sounds/%s/%s: path too long", prefix, entries[i].name);
+            continue;
+        }
+
+        if (entries[i].is_dir) {
+            if (depth < MAX_SOUND_DEPTH) scan_sound_directory(relative, depth + 1);
+        } else if (is_audio_file(entries[i].name)) {
+            SoundInfo *info = &sound_registry[num_registered_sounds++];
+            memset(info, 0, sizeof(*info));
+            snprintf(info->name, sizeof(info->name), "%s", relative);
+            info->size = entries[i].size;
+            info->mtime = entries[i].mtime;
+        }
+    }
+
+    free(entries);
+}
+
+// Warm start: fill in rate/length from the index if size and mtime still match.
+// Returns how many entries had to be probed (0 = index was fully valid).
+static int load_sound_index(void) {
+    SoundInfo *cached = (SoundInfo *)calloc(MAX_SOUNDS, sizeof(SoundInfo));
+    int num_cached = 0;
+    FILE *file = fopen(SOUND_INDEX_PATH, "r");
+    if (cached && file) {
+        char line[512];
+        while (num_cached < MAX_SOUNDS && fgets(line, sizeof(line), file)) {
+            SoundInfo *info = &cached[num_cached];
+            unsigned long long size, mtime, frames;
+            unsigned rate;
+            int name_offset = 0;
+            if (line[0] == '#') continue;
+            if (sscanf(line, "%llu %llu %u %llu %n", &size, &mtime, &rate, &frames, &name_offset) != 4) continue;
+            line[strcspn(line, "\r\n")] = 0;
+            snprintf(info->name, sizeof(info->name), "%s", line + name_offset);
+            info->size = size;
+            info->mtime = mtime;
+            info->sample_rate = rate;
+            info->frames = frames;
+            num_cached++;
+        }
+    }
+    if (file) fclose(file);
+
+    int probed = 0;
+    for (int i = 0; i < num_registered_sounds; i++) {
+        SoundInfo *info = &sound_registry[i];
+        int hit = 0;
+        for (int j = 0; j < num_cached; j++) {
+            if (cached[j].size == info->size && cached[j].mtime == info->mtime &&
+                strcmp(cached[j].name, info->name) == 0) {
+                info->sample_rate = cached[j].sample_rate;
+                info->frames = cached[j].frames;
+                hit = 1;
+                break;
+            }
+        }
+        if (hit) continue;
+
+        // Cache miss - open the file to learn its native format and length
+        char filepath[512];
+        ma_decoder decoder;
+        snprintf(filepath, sizeof(filepath), "sounds/%s", info->name);
+        if (ma_decoder_init_file(filepath, NULL, &decoder) == MA_SUCCESS) {
+            info->sample_rate = decoder.outputSampleRate;
+            ma_decoder_get_length_in_pcm_frames(&decoder, &info->frames);
+            ma_decoder_uninit(&decoder);
+        }
+        probed++;
+    }
+
+    free(cached);
+    return probed;
+}
+
+static void save_sound_index(void) {
+    FILE *file = fopen(SOUND_INDEX_PATH, "w");
+    if (!file) return;
+    fprintf(file, "# size mtime sample_rate frames name\n");
+    for (int i = 0; i < num_registered_sounds; i++) {
+        const SoundInfo *info = &sound_registry[i];
+        fprintf(file, "%llu %llu %u %llu %s\n", (unsigned long long)info->size,
+                (unsigned long long)info->mtime, info->sample_rate,
+                (unsigned long long)info->frames, info->name);
+    }
+    fclose(file);
+}
+
+void scan_sound_files() {
+#ifdef _WIN32
     CreateDirectory("sounds", NULL);
-    hFind = FindFirstFile("sounds\\*.wav", &findFileData);
+#else
+    mkdir("sounds", 0755);
+#endif
     
-    if (hFind == INVALID_HANDLE_VALUE) {
-        printf("No WAV files found in sounds/ folder\n");
-        printf("Put .wav files in sounds/ folder for WAV audio support\n");
+    printf("🎵 Scanning sounds folder...\n");
+    num_registered_sounds = 0;
+    // Before the early return below: with no sounds every letter stays missing
+    for (int i = 0; i < 26; i++) letter_sound_ids[i] = -1;
+    scan_sound_directory("", 0);
+    
+    if (num_registered_sounds == 0) {
+        printf("No sound files found in sounds/ folder\n");
+        printf("Put .wav/.flac/.mp3 files in sounds/ folder for WAV audio support\n");
         return;
     }
     
-    printf("🎵 Scanning sounds folder...\n");
-    num_registered_sounds = 0;
+    int probed = load_sound_index();
+    if (probed > 0) {
+        save_sound_index();
+    }
     
-    do {
-        if (num_registered_sounds >= MAX_SOUNDS) break;
-        
-        strcpy(sound_registry[num_registered_sounds], findFileData.cFileName);
-        printf("   %d: %s\n", num_registered_sounds, findFileData.cFileName);
-        num_registered_sounds++;
-        
-    } while (FindNextFile(hFind, &findFileData) != 0 && num_registered_sounds < MAX_SOUNDS);
+    for (int i = 0; i < num_registered_sounds; i++) {
+        printf("   %d: %s\n", i, sound_registry[i].name);
+    }
+    printf("🎵 Found %d sound files (%d probed, %d from index)\n",
+           num_registered_sounds, probed, num_registered_sounds - probed);
     
-    FindClose(hFind);
-    printf("🎵 Found %d WAV files\n", num_registered_sounds);
-#endif
+    index_letter_sounds();
 }
 
-// Frequency-based audio functions
-void play_frequency(int frequency, float duration) {
-    if (audio_muted) return;
+// Map A..Z to "alphabet/<letter>.<ext>" so letters never need a name lookup
+static void index_letter_sounds(void) {
+    const size_t dir_len = strlen(LETTER_SOUND_DIR);
+    int found = 0;
     
-    printf("Playing %dHz for %.1fs\n", frequency, duration);
+    for (int i = 0; i < num_registered_sounds; i++) {
+        const char *name = sound_registry[i].name;
+        if (strncmp(name, LETTER_SOUND_DIR, dir_len) != 0) continue;
+        char letter = name[dir_len];
+        if (letter >= 'a' && letter <= 'z') letter -= 32;
+        if (letter < 'A' || letter > 'Z' || name[dir_len + 1] != '.') continue;
+        if (letter_sound_ids[letter - 'A'] < 0) {
+            letter_sound_ids[letter - 'A'] = i;
+            found++;
+        }
+    }
     
+    printf("🔤 Letter sounds: %d/26 in %s\n", found, LETTER_SOUND_DIR);
+}
+
+// Decode every registered file up front so triggers never touch the disk.
+// Each loader thread pulls the next undecoded ID until the registry runs out.
+static void sound_bank_loader(void *arg) {
+    (void)arg;
+    for (;;) {
+        if (atomic_load(&bank_cancel)) break;
+        int id = atomic_fetch_add(&bank_next_job, 1);
+        if (id >= num_registered_sounds) break;
+
+        char filepath[512];
+        snprintf(filepath, sizeof(filepath), "sounds/%s", sound_registry[id].name);
+
+        ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 2, output_sample_rate);
+        void *frames = NULL;
+        ma_uint64 frame_count = 0;
+        ma_result result;
+        TRACE_ZONE("decode sound", result = ma_decode_file(filepath, &config, &frame_count, &frames));
+
+        if (result == MA_SUCCESS && frame_count > 0) {
+            sound_bank[id].pcm = (float *)frames;
+            sound_bank[id].frames = frame_count;
+            atomic_fetch_add(&bank_bytes, (size_t)frame_count * 2 * sizeof(float));
+            atomic_fetch_add(&bank_loaded, 1);
+            atomic_store_explicit(&sound_ready[id], 1, memory_order_release);
+        } else {
+            ma_free(frames, NULL);
+            atomic_store_explicit(&sound_ready[id], 2, memory_order_release);
+            LOG(LOG_AUDIO, LOG_ERROR, "   Failed to decode %s (error: %d)", sound_registry[id].name, result);
+        }
+
+        // Whoever finishes the last job reports the startup cost
+        if (atomic_fetch_sub(&bank_jobs_left, 1) == 1) {
+            double elapsed_ms = (platform_time_ns() - bank_start_ns) / 1000000.0;
+            printf("🎵 Sound bank: %d/%d decoded in %.1f ms on %d threads (%.1f MB resident)\n",
+                   atomic_load(&bank_loaded), num_registered_sounds, elapsed_ms, num_bank_loaders,
+                   atomic_load(&bank_bytes) / (1024.0 * 1024.0));
+        }
+    }
+}
+
+static void sound_bank_loader_thread(void *arg) {
+    trace_thread_name("sound bank loader");
+    sound_bank_loader(arg);
+}
+
+static void start_sound_bank_loaders(void) {
+    if (num_registered_sounds == 0) return;
+
+    atomic_store(&bank_next_job, 0);
+    atomic_store(&bank_jobs_left, num_registered_sounds);
+    atomic_store(&bank_cancel, 0);
+    bank_start_ns = platform_time_ns();
+
+    int threads = platform_cpu_count();
+    if (threads > MAX_BANK_LOADERS) threads = MAX_BANK_LOADERS;
+    if (threads > num_registered_sounds) threads = num_registered_sounds;
+
+    num_bank_loaders = 0;
+    for (int i = 0; i < threads; i++) {
+        platform_thread *thread = platform_thread_start(sound_bank_loader_thread, NULL);
+        if (thread) bank_loaders[num_bank_loaders++] = thread;
+    }
+
+    if (num_bank_loaders == 0) {
+        // No threads available - decode everything right here instead
+        num_bank_loaders = 1;
+        sound_bank_loader(NULL);
+        num_bank_loaders = 0;
+    }
+}
+
+static void join_sound_bank_loaders(void) {
+    for (int i = 0; i < num_bank_loaders; i++) {
+        platform_thread_join(bank_loaders[i]);
+        bank_loaders[i] = NULL;
+    }
+    num_bank_loaders = 0;
+}
+
+int is_sound_ready(int sound_id) {
+    if (sound_id < 0 || sound_id >= num_registered_sounds) return 0;
+    return atomic_load_explicit(&sound_ready[sound_id], memory_order_acquire) == 1;
+}
+
+int sound_bank_loading(void) {
+    return num_bank_loaders > 0 && atomic_load(&bank_jobs_left) > 0;
+}
+
+void wait_for_sound_bank(void) {
+    join_sound_bank_loaders();
+}
+
+static void free_sound_bank(void) {
+    atomic_store(&bank_cancel, 1);
+    join_sound_bank_loaders();
+    for (int i = 0; i < MAX_SOUNDS; i++) {
+        atomic_store(&sound_ready[i], 0);
+        ma_free(sound_bank[i].pcm, NULL);
+        sound_bank[i].pcm = NULL;
+        sound_bank[i].frames = 0;
+    }
+}
+
+// Frequency-based audio functions
+void play_frequency(int frequency, float duration) {
+    play_tone_with_type(frequency, WAVE_SINE, duration);
+}
+
+// Fallback when no audio device could be opened (blocks for the duration)
+static void play_frequency_beep(int frequency, float duration) {
+    if (audio_disabled) return;
 #ifdef _WIN32
     if (frequency >= 37 && frequency <= 32767) {
         int duration_ms = (int)(duration * 1000);
         Beep(frequency, duration_ms);
     } else {
-        printf("→ Frequency out of range, using 440Hz\n");
+        LOG(LOG_AUDIO, LOG_WARN, "→ Frequency out of range, using 440Hz");
         Beep(440, (int)(duration * 1000));
     }
 #endif
@@ -110,23 +832,70 @@ void play_beep(int frequency) {
     play_frequency(frequency, 0.3f);
 }
 
+// Non-blocking: queues a note for the synth voice pool and returns
 void play_tone_with_type(int frequency, int wave_type, float duration) {
-    printf("Playing %dHz (wave_type=%d) for %.1fs\n", frequency, wave_type, duration);
+    if (audio_muted) return;
     
-    // For different wave types, we can modify the frequency slightly or use different durations
-    switch(wave_type % 4) {
-        case 0: // Sine - normal
-            play_frequency(frequency, duration);
-            break;
-        case 1: // Square - shorter, punchier
-            play_frequency(frequency, duration * 0.8f);
-            break;
-        case 2: // Triangle - slightly higher pitch
-            play_frequency((int)(frequency * 1.1f), duration);
-            break;
-        case 3: // Sawtooth - lower pitch
-            play_frequency((int)(frequency * 0.9f), duration);
-            break;
+    LOG(LOG_AUDIO, LOG_INFO, "Playing %dHz (wave_type=%d) for %.1fs", frequency, wave_type, duration);
+    
+    if (!use_miniaudio) {
+        play_frequency_beep(frequency, duration);
+        return;
+    }
+
+    if (frequency <= 0 || frequency >= (int)output_sample_rate / 2) {
+        LOG(LOG_AUDIO, LOG_WARN, "→ Frequency out of range, using 440Hz");
+        frequency = 440;
+    }
+
+    AudioEvent event = {0};
+    event.type = AUDIO_EVENT_NOTE;
+    event.note_id = -1;
+    event.wave_type = wave_type % 4;
+    event.frequency = (float)frequency;
+    event.frames = (ma_uint64)(duration * output_sample_rate);
+    if (!audio_push_event(&event)) {
+        LOG(LOG_AUDIO, LOG_WARN, "→ Synth queue full, note dropped");
+    }
+}
+
+// Held notes: the voice sustains until note_off() with the same note_id
+void note_on(int note_id, int frequency, int wave_type) {
+    if (audio_muted) return;
+    
+    LOG(LOG_AUDIO, LOG_INFO, "Note on %d: %dHz (wave_type=%d)", note_id, frequency, wave_type);
+    
+    if (!use_miniaudio) {
+        play_frequency_beep(frequency, 0.3f);
+        return;
+    }
+    
+    if (frequency <= 0 || frequency >= (int)output_sample_rate / 2) {
+        LOG(LOG_AUDIO, LOG_WARN, "→ Frequency out of range, using 440Hz");
+        frequency = 440;
+    }
+    
+    AudioEvent event = {0};
+    event.type = AUDIO_EVENT_NOTE;
+    event.note_id = note_id;
+    event.wave_type = wave_type % 4;
+    event.frequency = (float)frequency;
+    event.frames = SYNTH_SUSTAIN_HELD;
+    if (!audio_push_event(&event)) {
+        LOG(LOG_AUDIO, LOG_WARN, "→ Synth queue full, note dropped");
+    }
+}
+
+void note_off(int note_id) {
+    if (!use_miniaudio) return;
+    
+    LOG(LOG_AUDIO, LOG_INFO, "Note off %d", note_id);
+    
+    AudioEvent event = {0};
+    event.type = AUDIO_EVENT_NOTE_OFF;
+    event.note_id = note_id;
+    if (!audio_push_event(&event)) {
+        LOG(LOG_AUDIO, LOG_WARN, "→ Synth queue full, note off dropped");
     }
 }
 
@@ -134,57 +903,69 @@ void play_tone_with_type(int frequency, int wave_type, float duration) {
 void play_wav_file_by_id(int sound_id) {
     if (audio_muted) return;
     
-    printf("Playing WAV ID %d\n", sound_id);
+    LOG(LOG_AUDIO, LOG_INFO, "Playing WAV ID %d", sound_id);
     
     if (sound_id < 0 || sound_id >= num_registered_sounds) {
-        printf("Invalid WAV ID: %d (available: 0-%d)\n", sound_id, num_registered_sounds-1);
+        LOG(LOG_AUDIO, LOG_WARN, "Invalid WAV ID: %d (available: 0-%d)", sound_id, num_registered_sounds-1);
         play_beep(220);
         return;
     }
     
-    printf("→ Playing: %s\n", sound_registry[sound_id]);
+    LOG(LOG_AUDIO, LOG_INFO, "→ Playing: %s", sound_registry[sound_id].name);
     
-    if (use_miniaudio) {
-        char filepath[512];
-        snprintf(filepath, sizeof(filepath), "sounds\\%s", sound_registry[sound_id]);
-        
-        ma_result result = ma_engine_play_sound(&engine, filepath, NULL);
-        if (result == MA_SUCCESS) {
-            printf("WAV played successfully\n");
-        } else {
-            printf("WAV playback failed (error: %d), using beep\n", result);
-            play_beep(440 + (sound_id * 100));
+    if (use_miniaudio && is_sound_ready(sound_id)) {
+        // Just a voice allocation - the PCM is already resident
+        AudioEvent event = {0};
+        event.type = AUDIO_EVENT_SAMPLE;
+        event.sound_id = sound_id;
+        if (!audio_push_event(&event)) {
+            LOG(LOG_AUDIO, LOG_WARN, "WAV queue full, sound dropped");
         }
+    } else if (use_miniaudio && sound_bank_loading()
+               && atomic_load(&sound_ready[sound_id]) == 0) {
+        LOG(LOG_AUDIO, LOG_INFO, "WAV still loading, skipped");
+    } else if (use_miniaudio) {
+        LOG(LOG_AUDIO, LOG_WARN, "WAV not in sound bank, using beep");
+        play_beep(440 + (sound_id * 100));
     } else {
-        printf("   → Miniaudio unavailable, playing beep substitute\n");
+        LOG(LOG_AUDIO, LOG_WARN, "   → Miniaudio unavailable, playing beep substitute");
         play_beep(440 + (sound_id * 100));
     }
 }
 
+// Letters come from the resident bank like any other sound, so they overlap
+// instead of cutting each other off and never touch the disk
+void play_letter_sound(char letter) {
+    if (letter >= 'a' && letter <= 'z') letter -= 32;
+    if (letter < 'A' || letter > 'Z') return;
+    
+    int sound_id = letter_sound_ids[letter - 'A'];
+    if (sound_id < 0) {
+        LOG(LOG_AUDIO, LOG_WARN, "No letter sound for '%c'", letter);
+        return;
+    }
+    play_wav_file_by_id(sound_id);
+}
+
 void play_wav_file_by_name(const char* filename) {
     for (int i = 0; i < num_registered_sounds; i++) {
-        if (strcmp(sound_registry[i], filename) == 0) {
+        if (strcmp(sound_registry[i].name, filename) == 0) {
             play_wav_file_by_id(i);
             return;
         }
     }
     
-    printf("WAV file '%s' not found\n", filename);
+    LOG(LOG_AUDIO, LOG_WARN, "WAV file '%s' not found", filename);
     play_beep(220);
 }
 
 // Combined functions
 void play_sound_mixed(int frequency, int sound_id, float duration) {
-    printf("Playing MIXED: %dHz + WAV %d for %.1fs\n", frequency, sound_id, duration);
+    LOG(LOG_AUDIO, LOG_INFO, "Playing MIXED: %dHz + WAV %d for %.1fs", frequency, sound_id, duration);
     
-    // Play frequency
+    // Both start in the same callback now that tones are mixed, no pause needed
     play_frequency(frequency, duration);
     
-    // Brief pause
-#ifdef _WIN32
-    Sleep(50);
-#endif
-    
     // Play WAV if valid
     if (sound_id >= 0 && sound_id < num_registered_sounds) {
         play_wav_file_by_id(sound_id);
@@ -192,7 +973,7 @@ void play_sound_mixed(int frequency, int sound_id, float duration) {
 }
 
 void play_key_sound(char key, int frequency, int wav_id, int wave_type) {
-    printf("Key '%c': freq=%dHz, wav=%d, wave_type=%d\n", key, frequency, wav_id, wave_type);
+    LOG(LOG_AUDIO, LOG_INFO, "Key '%c': freq=%dHz, wav=%d, wave_type=%d", key, frequency, wav_id, wave_type);
     
     if (wav_id >= 0 && wav_id < num_registered_sounds) {
         play_sound_mixed(frequency, wav_id, 0.3f);
@@ -210,17 +991,22 @@ const char* get_sound_name_by_id(int sound_id) {
     if (sound_id < 0 || sound_id >= num_registered_sounds) {
         return "Invalid";
     }
-    return sound_registry[sound_id];
+    return sound_registry[sound_id].name;
 }
 
 void list_available_sounds() {
     printf("=== AVAILABLE WAV FILES ===\n");
     if (num_registered_sounds == 0) {
-        printf("   No WAV files found\n");
-        printf("   Put .wav files in sounds/ folder\n");
+        printf("   No sound files found\n");
+        printf("   Put .wav/.flac/.mp3 files in sounds/ folder\n");
     } else {
         for (int i = 0; i < num_registered_sounds; i++) {
-            printf("   ID %d: %s\n", i, sound_registry[i]);
+            const SoundInfo *info = &sound_registry[i];
+            if (info->sample_rate > 0) {
+                printf("   ID %d: %s (%.2fs)\n", i, info->name, (double)info->frames / info->sample_rate);
+            } else {
+                printf("   ID %d: %s\n", i, info->name);
+            }
         }
     }
     printf("=== END OF LIST ===\n");
@@ -229,21 +1015,23 @@ void list_available_sounds() {
 // Control functions
 void stop_all_sounds() {
     if (use_miniaudio) {
-        ma_engine_stop(&engine);
-        printf("All sounds stopped\n");
+        AudioEvent event = {0};
+        event.type = AUDIO_EVENT_STOP_ALL;
+        audio_push_event(&event);
+        LOG(LOG_AUDIO, LOG_INFO, "All sounds stopped");
     }
 }
 
 void set_master_volume(float volume) {
     if (use_miniaudio) {
-        ma_engine_set_volume(&engine, volume);
-        printf("Volume set to %.1f\n", volume);
+        master_volume = volume;
+        LOG(LOG_AUDIO, LOG_INFO, "Volume set to %.1f", volume);
     }
 }
 
 void mute_audio(int mute) {
     audio_muted = mute;
-    printf("Audio %s\n", mute ? "muted" : "unmuted");
+    LOG(LOG_AUDIO, LOG_INFO, "Audio %s", mute ? "muted" : "unmuted");
 }
 
 int is_audio_initialized() {
@@ -268,9 +1056,20 @@ void play_sound_by_id(int sound_id) {
 }
 
 void cleanup_audio() {
-    if (audio_initialized && use_miniaudio) {
-        ma_engine_uninit(&engine);
+    if (audio_initialized && offline_mode) {
+        ma_encoder_uninit(&offline_encoder);
+        free_sound_bank();
+        offline_mode = 0;
+        printf("Offline render finished (%llu frames)\n", offline_frames_written);
+    } else if (audio_initialized && use_miniaudio) {
+        ma_device_uninit(&device);
+        free_sound_bank();
+        if (use_null_context) {
+            ma_context_uninit(&null_context);
+            use_null_context = 0;
+        }
         printf("Enhanced audio system cleaned up\n");
     }
+    audio_disabled = 0;
     audio_initialized = 0;
 }
\ No newline at end of file
@@ -7,6 +7,22 @@ extern "C" {
 
 // Core audio functions
 void init_audio();
+void init_audio_headless();     // Same mixer, driven by miniaudio's null backend
+
+// Offline rendering: no device, the caller owns the sample clock.
+// audio_offline_render() mixes the next frames on the calling thread and
+// appends them to the WAV file; cleanup_audio() finalizes it.
+int init_audio_offline(const char *wav_path, unsigned sample_rate);
+void audio_offline_render(unsigned long long frames);
+unsigned long long audio_offline_frames(void);
+int audio_voices_active(void);
+
+// Mix the next frames into out (interleaved stereo, silenced by the caller)
+// on the calling thread, exactly as the device callback would. For offline
+// tools such as bench; only use it after init_audio_offline().
+void audio_mix_frames(float *out, unsigned frames);
+// Silence every voice at once, without the release ramp. Offline only too.
+void audio_kill_voices(void);
 void cleanup_audio();
 int is_audio_initialized();
 
@@ -15,11 +31,16 @@ void play_sound(int frequency);
 void play_sound_with_duration(int frequency, float duration);
 void play_note(int frequency, float duration);
 
-// Enhanced frequency functions
+// Enhanced frequency functions (non-blocking, mixed by the synth voice pool)
+// wave_type: 0=sine, 1=square, 2=triangle, 3=sawtooth
 void play_frequency(int frequency, float duration);
 void play_beep(int frequency);
 void play_tone_with_type(int frequency, int wave_type, float duration);
 
+// Held notes (sustain until released, any number at once)
+void note_on(int note_id, int frequency, int wave_type);
+void note_off(int note_id);
+
 // WAV file functions
 void scan_sound_files();
 int get_sound_count();
@@ -27,6 +48,12 @@ const char* get_sound_name_by_id(int sound_id);
 void list_available_sounds();
 void play_wav_file_by_id(int sound_id);
 void play_wav_file_by_name(const char* filename);
+void play_letter_sound(char letter);     // sounds/alphabet/A-Z, case-insensitive
+
+// Sound bank (decoded in the background by init_audio)
+int is_sound_ready(int sound_id);
+int sound_bank_loading();
+void wait_for_sound_bank();
 
 // Combined audio functions
 void play_sound_mixed(int frequency, int sound_id, float duration);
@@ -0,0 +1,342 @@
+// Microbenchmarks for the emulator's hot paths.
+//
+// Built like the emulator itself, with bench.cpp in place of main.cpp (same
+// sources, same ../teenyat.c). Run it from this directory so sounds/ is found:
+//
+//   bench [--json FILE] [--quick] [program.bin ...]
+//
+// Every benchmark runs a fixed amount of work BENCH_REPEATS times and keeps
+// the median, so two runs on the same machine are comparable. Results go to
+// stdout as a table and, with --json, to FILE for tracking between releases.
+// Each program.bin (e.g. the shipped .asm files, assembled) is run headless
+// with no input, i.e. in its idle loop, to get guest instructions per second.
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "../teenyat.h"
+#include "audio.h"
+#include "bus.h"
+#include "graphics.h"
+#include "log.h"
+#include "piano.h"
+#include "platform.h"
+
+
+using namespace std;
+
+const int BENCH_REPEATS = 5;
+const unsigned BENCH_RATE = 48000;
+const unsigned BENCH_BUFFER_FRAMES = 512;       // One device callback's worth
+const char *BENCH_WAV = "bench_audio.wav";      // Offline mixer needs somewhere to write
+
+struct BenchResult {
+    string name;
+    string unit;
+    double value;
+    uint64_t ops;           // Operations per repeat
+    int voices;             // Mixer cases: voices actually mixed, else -1
+};
+
+static vector<BenchResult> results;
+static teenyat bench_cpu;   // Port handlers never look at it
+
+// Time fn(ops) BENCH_REPEATS times; returns the median nanoseconds per op
+template <typename Fn>
+static double time_per_op(uint64_t ops, Fn fn) {
+    vector<double> samples;
+    fn(ops / 10 + 1);       // Warm-up
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        uint64_t start = platform_time_ns();
+        fn(ops);
+        samples.push_back((double)(platform_time_ns() - start) / ops);
+    }
+    sort(samples.begin(), samples.end());
+    return samples[BENCH_REPEATS / 2];
+}
+
+static void report(const string &name, const string &unit, double value, uint64_t ops, int voices = -1) {
+    results.push_back({name, unit, value, ops, voices});
+    printf("  %-36s %14.2f %s\n", name.c_str(), value, unit.c_str());
+}
+
+// GET_KEY with an empty queue: what every idle guest does all day
+static void bench_bus_read(uint64_t scale) {
+    uint64_t ops = 2000000 * scale;
+    double ns = time_per_op(ops, [](uint64_t n) {
+        tny_word data;
+        uint16_t delay;
+        for (uint64_t i = 0; i < n; i++) {
+            bus_read(&bench_cpu, 0x9000, &data, &delay);
+        }
+    });
+    report("bus_read_get_key", "ns/op", ns, ops);
+}
+
+// SHOW_KEY on keys with no sound mapped: dispatch plus publishing the key look
+static void bench_bus_write(uint64_t scale) {
+    uint64_t ops = 2000000 * scale;
+    double ns = time_per_op(ops, [](uint64_t n) {
+        uint16_t delay;
+        for (uint64_t i = 0; i < n; i++) {
+            tny_word data;
+            data.u = (tny_uword)('a' + i % 26);
+            bus_write(&bench_cpu, 0x9003, data, &delay);
+        }
+    });
+    apply_key_visuals();
+    report("bus_write_show_key", "ns/op", ns, ops);
+}
+
+// One 60 fps frame of highlight bookkeeping with `lit` keys counting down.
+// Keys are re-lit between timed stretches, so only update_piano_state counts.
+// Each stretch outlasts the highlight, so every key also expires in it.
+static void bench_piano_state(uint64_t scale, int lit) {
+    const uint64_t frame_ns = 16666667;
+    const uint64_t frames_per_light = 60;       // 1 s, longer than the 800ms SHOW_KEY highlight
+    static uint64_t clock_ns = 1000000000ull;
+    uint64_t ops = 200000 * scale;
+
+    vector<double> samples;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        uint64_t timed_ns = 0;
+        for (uint64_t done = 0; done < ops; done += frames_per_light) {
+            uint16_t delay;
+            for (int k = 0; k < lit; k++) {
+                tny_word data;
+                data.u = (tny_uword)(k + 1);
+                bus_write(&bench_cpu, 0x9003, data, &delay);
+            }
+            apply_key_visuals();
+
+            uint64_t start = platform_time_ns();
+            for (uint64_t i = 0; i < frames_per_light; i++) {
+                clock_ns += frame_ns;
+                update_piano_state(clock_ns);
+            }
+            timed_ns += platform_time_ns() - start;
+        }
+        samples.push_back((double)timed_ns / ops);
+    }
+    sort(samples.begin(), samples.end());
+    report("update_piano_state_lit_" + to_string(lit), "ns/frame", samples[BENCH_REPEATS / 2], ops);
+}
+
+// Headless frames: keyboard snapshot and event diff, no drawing (see bench_draw)
+static void bench_graphics(uint64_t scale) {
+    uint64_t ops = 500000 * scale;
+    double ns = time_per_op(ops, [](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            update_graphics();
+        }
+    });
+    report("update_graphics_headless", "frames/s", 1e9 / ns, ops);
+}
+
+// Drawing a frame off-screen with `dirty` keys changed since the last one.
+// Every frame toggles the same keys, so they alternate between lit sprite
+// and background blits.
+static void bench_draw(uint64_t scale, int dirty) {
+    const char *bench_keys = "qwertyuiopasdfghjklzxcvbnm1234567890";
+    uint64_t ops = 100000 * scale;
+    bool lit = false;
+    graphics_draw_offscreen(true);
+    double ns = time_per_op(ops, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            lit = !lit;
+            for (int k = 0; k < dirty; k++) {
+                set_key_pressed(bench_keys[k], lit);
+            }
+            graphics_draw_offscreen(false);
+        }
+    });
+    report("draw_dirty_keys_" + to_string(dirty), "ns/frame", ns, ops);
+    for (int k = 0; k < dirty; k++) {
+        set_key_pressed(bench_keys[k], false);
+    }
+    graphics_draw_offscreen(false);
+}
+
+// Repainting the whole frame, as after the first frame, with 8 keys lit
+static void bench_draw_full(uint64_t scale) {
+    uint64_t ops = 10000 * scale;
+    for (const char *key = "asdfghjk"; *key; key++) {
+        set_key_pressed(*key, true);
+    }
+    double ns = time_per_op(ops, [](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            graphics_draw_offscreen(true);
+        }
+    });
+    report("draw_full_redraw", "ns/frame", ns, ops);
+    for (const char *key = "asdfghjk"; *key; key++) {
+        set_key_pressed(*key, false);
+    }
+    graphics_draw_offscreen(false);
+}
+
+// Mixing one device buffer with `voices` voices: synth notes first, then
+// bank samples once the synth pool is full. The voice pools are fixed, so
+// the case is named after the voices that really played, and dropped when
+// the cap makes it a repeat of an earlier one.
+static void bench_mix(uint64_t scale, int voices) {
+    static float buffer[BENCH_BUFFER_FRAMES * 2];
+    const int synth_voices = 32;
+    uint64_t ops = 200 * scale;
+    int active = 0;
+
+    double ns = time_per_op(ops, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            if (i % 64 == 0) {
+                // Samples finish on their own, so restart the set regularly.
+                // Hard stop: voices still in their release would count too.
+                audio_kill_voices();
+                for (int v = 0; v < voices; v++) {
+                    if (v < synth_voices) {
+                        note_on(v, 220 + v * 10, v % 4);
+                    } else if (get_sound_count() > 0) {
+                        play_wav_file_by_id(v % get_sound_count());
+                    }
+                }
+            }
+            memset(buffer, 0, sizeof(buffer));
+            audio_mix_frames(buffer, BENCH_BUFFER_FRAMES);
+            if (i % 64 == 0) active = audio_voices_active();
+        }
+    });
+    audio_kill_voices();
+    if (active < voices) {
+        for (const BenchResult &r : results) {
+            if (r.voices == active) {
+                printf("  %-36s (only %d voices available, same as above)\n",
+                       ("audio_mix_" + to_string(voices) + "_voices").c_str(), active);
+                return;
+            }
+        }
+    }
+    report("audio_mix_" + to_string(active) + "_voices", "ns/buffer", ns, ops, active);
+    if (active < voices) {
+        printf("  %-36s (%d requested, only %d voices available)\n", "", voices, active);
+    }
+}
+
+// Guest instructions per second running a program with no input. A clock
+// with a bus delay pending only counts down the stall, so it retires nothing.
+static void bench_program(const char *path, uint64_t scale) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("  %s: could not open\n", path);
+        return;
+    }
+    teenyat t;
+    bool ok = tny_init_from_file(&t, file, bus_read, bus_write);
+    fclose(file);
+    if (!ok) {
+        printf("  %s: not a TeenyAT binary\n", path);
+        return;
+    }
+
+    uint64_t ops = 5000000 * scale;
+    uint64_t instructions = 0;
+    double ns = time_per_op(ops, [&t, &instructions](uint64_t n) {
+        instructions = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            if (t.delay_cycles == 0) instructions++;
+            tny_clock(&t);
+            bus_cycle_count++;
+        }
+    });
+
+    string name = path;
+    size_t slash = name.find_last_of("/\\");
+    if (slash != string::npos) name = name.substr(slash + 1);
+    // ns is per cycle; scale by the last repeat's instructions per cycle
+    report("guest_" + name + "_mips", "MIPS", 1000.0 / ns * instructions / ops, ops);
+}
+
+static string json_escape(const string &text) {
+    string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static bool write_json(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        cout << "Error: Could not create " << path << endl;
+        return false;
+    }
+    fprintf(file, "{\n  \"repeats\": %d,\n  \"results\": [\n", BENCH_REPEATS);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f, \"ops\": %llu",
+                json_escape(r.name).c_str(), r.unit.c_str(), r.value, (unsigned long long)r.ops);
+        if (r.voices >= 0) fprintf(file, ", \"voices\": %d", r.voices);
+        fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_path = NULL;
+    uint64_t scale = 10;
+    vector<const char *> programs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            scale = 1;
+        } else if (argv[i][0] == '-') {
+            cout << "Usage: " << argv[0] << " [--json FILE] [--quick] [program.bin ...]" << endl;
+            return 1;
+        } else {
+            programs.push_back(argv[i]);
+        }
+    }
+
+    // The same setup as a headless --render run, minus the guest
+    log_configure("off");
+    piano_register_ports();
+    if (!init_audio_offline(BENCH_WAV, BENCH_RATE)) {
+        return 1;
+    }
+    init_enhanced_piano_system(true);
+
+    cout << endl << "Benchmarks (median of " << BENCH_REPEATS << ")" << endl;
+    bench_bus_read(scale);
+    bench_bus_write(scale);
+    for (int lit : {1, 8, 32, 128}) {
+        bench_piano_state(scale, lit);
+    }
+    bench_graphics(scale);
+    for (int dirty : {1, 8, 32}) {
+        bench_draw(scale, dirty);
+    }
+    bench_draw_full(scale);
+    for (int voices : {1, 8, 32, 128}) {
+        bench_mix(scale, voices);
+    }
+    for (const char *program : programs) {
+        bench_program(program, scale);
+    }
+
+    cleanup_graphics();
+    cleanup_audio();
+    remove(BENCH_WAV);
+
+    if (json_path) {
+        if (!write_json(json_path)) return 1;
+        cout << "Results written to " << json_path << endl;
+    }
+    return 0;
+}
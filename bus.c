@@ -0,0 +1,291 @@
+#include "bus.h"
+#include "log.h"
+#include "platform.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define LATENCY_BUCKETS 128             // 4 per power of two up to 2^31 ns
+#define BUS_TRACE_MIN_NS 2000           // Accesses at least this slow become --trace zones
+
+typedef struct {
+    bus_read_handler read;
+    bus_write_handler write;
+    void *context;
+    const char *name;
+    const char *description;
+    int idle_poll;              // Empty reads count towards bus_guest_idle()
+} BusPort;
+
+static BusPort bus_ports[BUS_PORT_COUNT];
+
+uint64_t bus_cycle_count = 0;
+
+static uint32_t idle_reads = 0;             // Empty poll reads in a row
+static platform_event *wake_event = NULL;
+static bus_wait_handler wait_handler = NULL;
+static uint64_t wait_guest_hz = 0;
+static int latency_timing = 0;              // Off: handlers aren't timed
+
+// Only the emulation thread updates these; dumps from other threads may be
+// off by an access or two, which is fine for statistics. 64-bit, since a
+// guest polling at a few MHz wraps 32 bits within hours.
+typedef struct {
+    uint64_t reads;
+    uint64_t hits;
+    uint64_t writes;
+    uint64_t max_ns;
+    uint64_t latency[LATENCY_BUCKETS];
+} BusPortStats;
+
+static BusPortStats bus_stats[BUS_PORT_COUNT];
+static uint64_t bus_stats_start_ns = 0;
+static tny_uword stats_selection = 0;
+
+static int highest_bit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+}
+
+static int latency_bucket(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int msb = highest_bit(ns);
+    if (msb > 31) return LATENCY_BUCKETS - 1;
+    return msb * 4 + (int)((ns >> (msb - 2)) & 3);
+}
+
+// Smallest latency that lands in a bucket
+static uint64_t bucket_floor_ns(int bucket) {
+    if (bucket < 4) return (uint64_t)bucket;
+    int msb = bucket / 4;
+    return (1ull << msb) + ((uint64_t)(bucket % 4) << (msb - 2));
+}
+
+static uint64_t latency_percentile(const BusPortStats *stats, double fraction) {
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) total += stats->latency[i];
+    if (total == 0) return 0;
+    
+    uint64_t target = (uint64_t)(total * fraction);
+    if (target >= total) target = total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += stats->latency[i];
+        if (seen > target) return bucket_floor_ns(i);
+    }
+    return stats->max_ns;
+}
+
+static void record_latency(unsigned index, uint64_t start_ns, uint64_t end_ns) {
+    BusPortStats *stats = &bus_stats[index];
+    uint64_t ns = end_ns - start_ns;
+    stats->latency[latency_bucket(ns)]++;
+    if (ns > stats->max_ns) stats->max_ns = ns;
+    // Only the slow ones: a zone per access would flood the trace
+    if (trace_on && ns >= BUS_TRACE_MIN_NS) trace_zone(bus_ports[index].name, start_ns, end_ns);
+}
+
+int bus_register(tny_uword base, tny_uword count, const char *name, const char *description,
+                 bus_read_handler read, bus_write_handler write, void *context) {
+    if (count == 0 || base < BUS_PORT_BASE || base - BUS_PORT_BASE + count > BUS_PORT_COUNT) {
+        printf("Bus: %s at 0x%04X (+%u) is outside the I/O window\n", name, base, count);
+        return 0;
+    }
+    
+    unsigned first = base - BUS_PORT_BASE;
+    for (unsigned i = first; i < first + count; i++) {
+        if (bus_ports[i].name) {
+            printf("Bus: %s at 0x%04X overlaps %s\n", name, BUS_PORT_BASE + i, bus_ports[i].name);
+            return 0;
+        }
+    }
+    
+    if (bus_stats_start_ns == 0) bus_stats_start_ns = platform_time_ns();
+    
+    for (unsigned i = first; i < first + count; i++) {
+        bus_ports[i].read = read;
+        bus_ports[i].write = write;
+        bus_ports[i].context = context;
+        bus_ports[i].name = name;
+        bus_ports[i].description = description;
+    }
+    return 1;
+}
+
+void bus_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay) {
+    unsigned index = (unsigned)(tny_uword)(addr - BUS_PORT_BASE);
+    *delay = 0;
+    data->u = 0;
+    
+    if (index >= BUS_PORT_COUNT) {
+        idle_reads = 0;
+        return;
+    }
+    
+    BusPortStats *stats = &bus_stats[index];
+    stats->reads++;
+    if (bus_ports[index].read) {
+        if (latency_timing) {
+            uint64_t start = platform_time_ns();
+            bus_ports[index].read(t, addr, data, delay, bus_ports[index].context);
+            record_latency(index, start, platform_time_ns());
+        } else {
+            bus_ports[index].read(t, addr, data, delay, bus_ports[index].context);
+        }
+        if (data->u != 0) stats->hits++;
+    }
+    
+    if (bus_ports[index].idle_poll && data->u == 0) {
+        idle_reads++;
+    } else {
+        idle_reads = 0;
+    }
+}
+
+void bus_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay) {
+    unsigned index = (unsigned)(tny_uword)(addr - BUS_PORT_BASE);
+    *delay = 0;
+    idle_reads = 0;
+    
+    if (index < BUS_PORT_COUNT) {
+        BusPortStats *stats = &bus_stats[index];
+        stats->writes++;
+        if (bus_ports[index].write) {
+            if (latency_timing) {
+                uint64_t start = platform_time_ns();
+                bus_ports[index].write(t, addr, data, delay, bus_ports[index].context);
+                record_latency(index, start, platform_time_ns());
+            } else {
+                bus_ports[index].write(t, addr, data, delay, bus_ports[index].context);
+            }
+            return;
+        }
+        if (bus_ports[index].name) {
+            LOG(LOG_BUS, LOG_WARN, "Write to read-only port %s (0x%x)", bus_ports[index].name, addr);
+            return;
+        }
+    }
+    LOG(LOG_BUS, LOG_WARN, "Unknown I/O address: 0x%x", addr);
+}
+
+void bus_print_ports(void) {
+    for (unsigned i = 0; i < BUS_PORT_COUNT; i++) {
+        if (!bus_ports[i].name) continue;
+        // Ranges are listed once, at their first address
+        if (i > 0 && bus_ports[i - 1].name == bus_ports[i].name) continue;
+        printf("  0x%04X - %s (%s)\n", BUS_PORT_BASE + i, bus_ports[i].name,
+               bus_ports[i].description ? bus_ports[i].description : "");
+    }
+}
+
+// ---- Idle detection ----
+
+void bus_mark_idle_poll(tny_uword addr) {
+    unsigned index = (unsigned)(tny_uword)(addr - BUS_PORT_BASE);
+    if (index >= BUS_PORT_COUNT) return;
+    bus_ports[index].idle_poll = 1;
+    // Created at startup, before any thread can call bus_wake()
+    if (!wake_event) wake_event = platform_event_create();
+}
+
+int bus_guest_idle(void) {
+    return idle_reads >= BUS_IDLE_READS;
+}
+
+int bus_idle_wait(uint64_t timeout_ns) {
+    idle_reads = 0;
+    if (!wake_event) return 0;
+    return platform_event_wait_ns(wake_event, timeout_ns);
+}
+
+void bus_wake(void) {
+    if (wake_event) platform_event_signal(wake_event);
+}
+
+// ---- Blocking reads ----
+
+void bus_set_wait_handler(bus_wait_handler handler, uint64_t guest_hz) {
+    wait_handler = handler;
+    wait_guest_hz = guest_hz;
+}
+
+uint64_t bus_ms_to_cycles(uint32_t ms) {
+    uint64_t cycles = ms * wait_guest_hz / 1000;
+    return ms && cycles == 0 ? 1 : cycles;
+}
+
+uint64_t bus_wait(uint64_t timeout_cycles, int (*ready)(void)) {
+    if (!wait_handler) return 0;
+    return wait_handler(timeout_cycles, ready);
+}
+
+// ---- Stats ports ----
+
+static uint16_t saturate16(uint64_t value) {
+    return value > 0xFFFF ? 0xFFFF : (uint16_t)value;
+}
+
+static void stats_select_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    stats_selection = data.u;
+}
+
+static void stats_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    const BusPortStats *stats = &bus_stats[stats_selection & 0xFF];
+    switch (stats_selection >> 12) {
+        case BUS_STAT_READS_LO:  data->u = (tny_uword)(stats->reads & 0xFFFF); break;
+        case BUS_STAT_READS_HI:  data->u = (tny_uword)((stats->reads >> 16) & 0xFFFF); break;
+        case BUS_STAT_HITS_LO:   data->u = (tny_uword)(stats->hits & 0xFFFF); break;
+        case BUS_STAT_HITS_HI:   data->u = (tny_uword)((stats->hits >> 16) & 0xFFFF); break;
+        case BUS_STAT_WRITES_LO: data->u = (tny_uword)(stats->writes & 0xFFFF); break;
+        case BUS_STAT_WRITES_HI: data->u = (tny_uword)((stats->writes >> 16) & 0xFFFF); break;
+        case BUS_STAT_P50_NS:    data->u = saturate16(latency_percentile(stats, 0.50)); break;
+        case BUS_STAT_P99_NS:    data->u = saturate16(latency_percentile(stats, 0.99)); break;
+        case BUS_STAT_MAX_NS:    data->u = saturate16(stats->max_ns); break;
+        default:                 data->u = 0; break;
+    }
+}
+
+void bus_set_latency_timing(int on) {
+    latency_timing = on;
+}
+
+void bus_register_stats_ports(void) {
+    bus_register(BUS_STATS_SELECT, 1, "STATS_SELECT", "select port/field for STATS_READ",
+                 NULL, stats_select_write, NULL);
+    bus_register(BUS_STATS_READ, 1, "STATS_READ", "read selected bus statistic",
+                 stats_read, NULL, NULL);
+}
+
+void bus_print_stats(void) {
+    double seconds = bus_stats_start_ns ? (platform_time_ns() - bus_stats_start_ns) / 1e9 : 0.0;
+    
+    printf("=== Bus stats (%.1f s%s) ===\n", seconds, latency_timing ? "" : ", handler latency not timed");
+    printf("  port   name                  reads      hits    writes    p50 ns    p99 ns    max ns\n");
+    for (unsigned i = 0; i < BUS_PORT_COUNT; i++) {
+        const BusPortStats *stats = &bus_stats[i];
+        if (stats->reads == 0 && stats->writes == 0) continue;
+        
+        const char *name = bus_ports[i].name ? bus_ports[i].name : "(unmapped)";
+        printf("  0x%04X %-16s %10llu %9llu %9llu %9llu %9llu %9llu", BUS_PORT_BASE + i, name,
+               (unsigned long long)stats->reads, (unsigned long long)stats->hits,
+               (unsigned long long)stats->writes,
+               (unsigned long long)latency_percentile(stats, 0.50),
+               (unsigned long long)latency_percentile(stats, 0.99),
+               (unsigned long long)stats->max_ns);
+        
+        // A guest spinning on an empty port shows up as lots of reads, almost no hits
+        if (bus_ports[i].read && stats->reads >= 10000 && stats->hits * 100 < stats->reads) {
+            printf("  <- busy polling (%.1f%% hits, %.0f reads/s)",
+                   100.0 * stats->hits / stats->reads, seconds > 0 ? stats->reads / seconds : 0.0);
+        }
+        printf("\n");
+    }
+}
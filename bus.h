@@ -0,0 +1,108 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include "../teenyat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Peripheral I/O window. Every address in it has one slot in a dense jump
+// table, so dispatch costs the same no matter how many ports are registered.
+#define BUS_PORT_BASE  0x9000
+#define BUS_PORT_COUNT 0x100       // 0x9000 - 0x90FF
+
+// Handlers get the address that was accessed (useful for ranges) and the
+// context pointer given at registration. Set *delay to stall the guest for
+// that many extra cycles; it starts at 0.
+typedef void (*bus_read_handler)(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context);
+typedef void (*bus_write_handler)(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context);
+
+// Claim [base, base + count) for a peripheral. Either handler may be NULL
+// (reads then return 0, writes are ignored). Returns 0 if the range is
+// outside the window or overlaps a port that is already registered.
+int bus_register(tny_uword base, tny_uword count, const char *name, const char *description,
+                 bus_read_handler read, bus_write_handler write, void *context);
+
+// Guest cycles executed so far. The emulation loop advances it after every
+// tny_clock(), so inside a handler it is the cycle of the current access.
+extern uint64_t bus_cycle_count;
+
+// Callbacks for tny_init_from_file
+void bus_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay);
+void bus_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay);
+
+// Print every registered port ("0x9000 - NAME (description)")
+void bus_print_ports(void);
+
+// ---- Idle detection ----
+// Mark a port whose empty (zero) reads mean the guest is waiting for input.
+// Once BUS_IDLE_READS of them arrive in a row with no other bus access in
+// between, bus_guest_idle() says so and the emulation loop can park.
+#define BUS_IDLE_READS 256
+
+void bus_mark_idle_poll(tny_uword addr);
+int bus_guest_idle(void);
+
+// Park the calling thread until bus_wake() or the timeout; returns 1 if woken.
+// Resets the idle count either way.
+int bus_idle_wait(uint64_t timeout_ns);
+
+// A peripheral has something new for the guest (any thread)
+void bus_wake(void);
+
+// ---- Blocking reads ----
+// A read handler with nothing to return yet can let guest time pass on the
+// host instead of making the guest poll. The host installs a wait handler:
+// it blocks (or, headless, moves virtual time forward) until ready() is
+// true, timeout_cycles of guest time have passed (0 = no limit) or the host
+// is stopping, and returns how many guest cycles went by. The read handler
+// reports them back through *delay; what doesn't fit in 16 bits is credited
+// to bus_cycle_count. Timeouts are in guest time so that headless runs and
+// replays don't depend on the host's clock.
+typedef uint64_t (*bus_wait_handler)(uint64_t timeout_cycles, int (*ready)(void));
+
+// guest_hz is the clock the handler counts cycles at
+void bus_set_wait_handler(bus_wait_handler handler, uint64_t guest_hz);
+
+// Guest cycles in ms of guest time, at least 1 for a non-zero ms
+uint64_t bus_ms_to_cycles(uint32_t ms);
+
+// 0 right away when no wait handler is installed
+uint64_t bus_wait(uint64_t timeout_cycles, int (*ready)(void));
+
+// ---- Instrumentation ----
+// Every access to the window is counted per port. With latency timing on,
+// the host time spent in its handler also goes into a log-bucketed histogram
+// (4 sub-buckets per power of two, so percentiles are within 25%). It costs
+// two clock reads per access, so it is off unless asked for and the latency
+// fields read 0.
+
+// Guest-visible stats: write [field:4][unused:4][port:8] to STATS_SELECT,
+// then read the value from STATS_READ. port is the offset from BUS_PORT_BASE.
+#define BUS_STATS_SELECT 0x90F0
+#define BUS_STATS_READ   0x90F1
+
+enum {
+    BUS_STAT_READS_LO = 0,      // Low 32 bits of each counter, in two 16-bit halves
+    BUS_STAT_READS_HI,
+    BUS_STAT_HITS_LO,           // Reads that returned non-zero data
+    BUS_STAT_HITS_HI,
+    BUS_STAT_WRITES_LO,
+    BUS_STAT_WRITES_HI,
+    BUS_STAT_P50_NS,            // Handler latency, saturates at 0xFFFF
+    BUS_STAT_P99_NS,
+    BUS_STAT_MAX_NS,
+};
+
+void bus_set_latency_timing(int on);
+void bus_register_stats_ports(void);
+
+// Per-port table of counts and latencies for every port that was touched
+void bus_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUS_H
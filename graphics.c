@@ -1,14 +1,23 @@
 #include "tigr.h"
 #include "graphics.h"
+#include "trace.h"
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define SCREEN_W 800
 #define SCREEN_H 400  // Slightly taller for better proportions
 #define KEY_W 35
 #define KEY_H 35
 #define MAX_KEYS 50
+#define KEY_WORDS 4             // 256-bit key bitsets
+#define MAX_FRAME_EVENTS 64
+#define BACKGROUND_COLOR tigrRGB(45, 55, 75)
+#define LAST_KEY_Y 120
 
 typedef struct {
     char label[8];
@@ -17,19 +26,51 @@ typedef struct {
     bool pressed;
     int r, g, b;
     bool is_piano;
+    Tigr *lit_sprite;       // Highlighted look, built on first use
+    bool lit_sprite_stale;  // Color changed since lit_sprite was drawn
 } Key;
 
 static Tigr *screen = NULL;
+static Tigr *background = NULL;             // Static chrome and every key in its idle look
 static Key keys[MAX_KEYS];
 static int keyCount = 0;
+static signed char key_slot[256];           // Keycode -> index into keys[], -1 if not on screen
 static bool initialized = false;
+static bool headless = false;              // No window, keys come from inject_key()
 static char last_key_detected = 0;
 static int last_key_time = 0;
-static int frame_counter = 0;
+static int frame_counter = 1;              // Advanced once per tigrUpdate
+static int key_repeat_frame[256];           // Frame a key last (auto-)repeated
+
+// Dirty tracking: the screen bitmap keeps its pixels between frames, so only
+// keys whose look changed (one bit per keys[] index) and the "Last Key" line
+// get redrawn. full_redraw repaints everything, e.g. for the first frame.
+// Nothing is rasterized per frame: the background bitmap doubles as every
+// key's idle sprite, and lit keys have a sprite of their own.
+static bool full_redraw = true;
+static uint64_t dirty_keys = 0;
+static char drawn_last_key = 0;             // What the "Last Key" line shows now
+
+// Keyboard snapshot, taken once per frame right after tigrUpdate. Bits are
+// indexed by the lowercase key we report. TIGR reports letters by their
+// uppercase ASCII code and digits by their ASCII code.
+static const char tracked_keys[] = "QWERTYUIOPASDFGHJKLZXCVBNM1234567890";
+static uint64_t key_held_bits[KEY_WORDS];
+
+// Headless input: what inject_key() has pressed since the last snapshot and
+// what is still held, in the same layout as key_held_bits
+static uint64_t injected_down[KEY_WORDS];
+static uint64_t injected_held[KEY_WORDS];
+
+// Transitions found by the last snapshot, handed out by poll_key_events
+static KeyInputEvent frame_events[MAX_FRAME_EVENTS];
+static int frame_event_count = 0;
+static int frame_event_read = 0;
 
 void addKey(const char *label, char keycode, int x, int y, int w, bool is_piano) {
     if (keyCount >= MAX_KEYS) return;
     
+    key_slot[(unsigned char)keycode] = (signed char)keyCount;
     strcpy(keys[keyCount].label, label);
     keys[keyCount].keycode = keycode;
     keys[keyCount].x = x;
@@ -41,16 +82,78 @@ void addKey(const char *label, char keycode, int x, int y, int w, bool is_piano)
     keys[keyCount].g = is_piano ? 80 : 60;
     keys[keyCount].b = is_piano ? 80 : 60;
     keys[keyCount].is_piano = is_piano;
+    keys[keyCount].lit_sprite = NULL;
+    keys[keyCount].lit_sprite_stale = true;
     keyCount++;
 }
 
+// Centered line of text (tigr's font is 6 pixels wide per char)
+static void print_centered(Tigr *dest, int y, TPixel color, const char *text) {
+    int width = (int)strlen(text) * 6;
+    tigrPrint(dest, tfont, SCREEN_W / 2 - width / 2, y, color, text);
+}
+
+// A key in its idle or highlighted look, with its top left corner at (x, y)
+static void render_key(Tigr *dest, const Key *key, bool pressed, int x, int y) {
+    TPixel keyColor, borderColor, textColor;
+    
+    if (pressed) {
+        // HIGHLIGHTED state - use custom colors
+        keyColor = tigrRGB(key->r, key->g, key->b);
+        borderColor = tigrRGB(255, 255, 255);
+        textColor = tigrRGB(0, 0, 0);
+    } else {
+        // NORMAL state
+        if (key->is_piano) {
+            keyColor = tigrRGB(70, 80, 100);    // Piano keys (darker)
+            borderColor = tigrRGB(120, 130, 150);
+        } else {
+            keyColor = tigrRGB(50, 55, 65);     // Number keys (lighter)
+            borderColor = tigrRGB(90, 95, 105);
+        }
+        textColor = tigrRGB(220, 220, 220);
+    }
+    
+    // Draw key background
+    tigrFill(dest, x, y, key->w, key->h, keyColor);
+    
+    // Draw key border
+    tigrRect(dest, x, y, key->w, key->h, borderColor);
+    
+    // Center text perfectly on key
+    int text_x = x + (key->w - 6) / 2;
+    int text_y = y + (key->h - 8) / 2;
+    tigrPrint(dest, tfont, text_x, text_y, textColor, key->label);
+}
+
+// Everything that never changes: background, titles, footer and the idle keys
+static void build_background(void) {
+    background = tigrBitmap(SCREEN_W, SCREEN_H);
+    
+    // Beautiful gradient background
+    tigrClear(background, BACKGROUND_COLOR);
+    
+    print_centered(background, 40, tigrRGB(255, 255, 255), "Leroy's Piano System");
+    print_centered(background, 65, tigrRGB(180, 180, 180), "TeenyAT Assembly Platform");
+    print_centered(background, 95, tigrRGB(150, 255, 150), "Press keys to play musical notes!");
+    print_centered(background, SCREEN_H - 25, tigrRGB(120, 130, 140), "Program sounds with TeenyAT assembly language!");
+    
+    for (int i = 0; i < keyCount; i++) {
+        render_key(background, &keys[i], false, keys[i].x, keys[i].y);
+    }
+}
+
 void init_graphics(void) {
     if (initialized) return;
     
-    screen = tigrWindow(SCREEN_W, SCREEN_H, "Leroy's Piano System", TIGR_FIXED);
-    if (!screen) {
-        printf("Failed to create window\n");
-        return;
+    memset(key_slot, -1, sizeof(key_slot));
+    
+    if (!headless) {
+        screen = tigrWindow(SCREEN_W, SCREEN_H, "Leroy's Piano System", TIGR_FIXED);
+        if (!screen) {
+            printf("Failed to create window\n");
+            return;
+        }
     }
     
     keyCount = 0;
@@ -91,11 +194,26 @@ void init_graphics(void) {
         addKey(row4_labels[i], row4_keys[i], row4_x + i * key_spacing, start_y + 135, KEY_W, true);
     }
     
+    if (!headless) build_background();
+    full_redraw = true;
     initialized = true;
-    printf("Graphics initialized (%d keys)\n", keyCount);
+    printf("Graphics initialized (%d keys%s)\n", keyCount, headless ? ", headless" : "");
+}
+
+void init_graphics_headless(void) {
+    headless = true;
+    init_graphics();
 }
 
 void cleanup_graphics(void) {
+    for (int i = 0; i < keyCount; i++) {
+        if (keys[i].lit_sprite) tigrFree(keys[i].lit_sprite);
+        keys[i].lit_sprite = NULL;
+    }
+    if (background) {
+        tigrFree(background);
+        background = NULL;
+    }
     if (screen) {
         tigrFree(screen);
         screen = NULL;
@@ -105,168 +223,208 @@ void cleanup_graphics(void) {
 }
 
 bool graphics_active(void) {
+    if (headless) return initialized;
     return screen && !tigrClosed(screen);
 }
 
 void set_key_color(char keycode, int r, int g, int b) {
-    for (int i = 0; i < keyCount; i++) {
-        if (keys[i].keycode == keycode) {
-            keys[i].r = r;
-            keys[i].g = g;
-            keys[i].b = b;
-            return;
-        }
-    }
+    int slot = key_slot[(unsigned char)keycode];
+    if (slot < 0) return;
+    if (keys[slot].r == r && keys[slot].g == g && keys[slot].b == b) return;
+    keys[slot].r = r;
+    keys[slot].g = g;
+    keys[slot].b = b;
+    keys[slot].lit_sprite_stale = true;
+    // Only shows while the key is lit
+    if (keys[slot].pressed) dirty_keys |= 1ull << slot;
 }
 
 void set_key_pressed(char keycode, bool pressed) {
-    for (int i = 0; i < keyCount; i++) {
-        if (keys[i].keycode == keycode) {
-            keys[i].pressed = pressed;
-            return;
-        }
-    }
+    int slot = key_slot[(unsigned char)keycode];
+    if (slot < 0) return;
+    if (keys[slot].pressed == pressed) return;
+    keys[slot].pressed = pressed;
+    dirty_keys |= 1ull << slot;
 }
 
-// Cross-platform keyboard input using TIGR's direct ASCII approach
-char get_key_input(void) {
-    if (!screen) return 0;
-    
-    frame_counter++;
-    
-    // TIGR uses direct ASCII values for most keys
-    // Check all the keys we care about using their ASCII values
-    char keys_to_check[] = {
-        // Letters (lowercase)
-        'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p',
-        'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l',
-        'z', 'x', 'c', 'v', 'b', 'n', 'm',
-        // Numbers
-        '1', '2', '3', '4', '5', '6', '7', '8', '9', '0',
-        // Uppercase versions (TIGR might use these)
-        'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P',
-        'A', 'S', 'D', 'F', 'G', 'H', 'J', 'K', 'L',
-        'Z', 'X', 'C', 'V', 'B', 'N', 'M'
-    };
-    
-    int num_keys = sizeof(keys_to_check) / sizeof(keys_to_check[0]);
+static int lowest_bit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+static void add_frame_event(int key, bool pressed, bool repeat) {
+    if (frame_event_count >= MAX_FRAME_EVENTS) return;
+    frame_events[frame_event_count++] = (KeyInputEvent){(char)key, pressed, repeat};
+    if (pressed) last_key_detected = (char)key;
+}
+
+// One pass of tigrKeyDown/tigrKeyHeld over the tracked keys per frame, then a
+// word-wise diff against the previous frame to find what changed
+static void snapshot_keyboard(void) {
+    uint64_t held[KEY_WORDS] = {0};
+    uint64_t down[KEY_WORDS] = {0};
     
-    // Check for key presses using tigrKeyDown with ASCII values
-    for (int i = 0; i < num_keys; i++) {
-        if (tigrKeyDown(screen, keys_to_check[i])) {
-            char detected_key = tolower(keys_to_check[i]); // Always return lowercase
-            
-            // Debounce: only register key if it's different from last or enough time has passed
-            if (last_key_detected != detected_key || 
-                frame_counter - last_key_time > 12) {  // ~12 frames = ~200ms at 60fps
-                
-                last_key_detected = detected_key;
-                last_key_time = frame_counter;
-                return detected_key;
+    if (headless) {
+        // A key pressed and released between two frames still counts as
+        // held for this one, like a quick tap on a real keyboard
+        for (int w = 0; w < KEY_WORDS; w++) {
+            down[w] = injected_down[w];
+            held[w] = injected_held[w] | injected_down[w];
+            injected_down[w] = 0;
+        }
+    } else {
+        for (int i = 0; tracked_keys[i]; i++) {
+            int code = tracked_keys[i];
+            int key = tolower(code);
+            uint64_t bit = 1ull << (key & 63);
+            if (tigrKeyDown(screen, code)) {
+                down[key >> 6] |= bit;
+                held[key >> 6] |= bit;
+            } else if (tigrKeyHeld(screen, code)) {
+                held[key >> 6] |= bit;
             }
         }
     }
     
-    // Alternative: Check if any key is held down using tigrKeyHeld
-    for (int i = 0; i < num_keys; i++) {
-        if (tigrKeyHeld(screen, keys_to_check[i])) {
-            char detected_key = tolower(keys_to_check[i]);
-            
-            if (last_key_detected != detected_key || 
-                frame_counter - last_key_time > 12) {
-                
-                last_key_detected = detected_key;
-                last_key_time = frame_counter;
-                return detected_key;
+    frame_event_count = 0;
+    frame_event_read = 0;
+    bool any_held = false;
+    
+    for (int w = 0; w < KEY_WORDS; w++) {
+        uint64_t prev = key_held_bits[w];
+        // A fresh tigrKeyDown on a key we already saw held means it was
+        // released and pressed again within one frame
+        uint64_t repressed = down[w] & prev;
+        uint64_t changed = (held[w] ^ prev) | repressed;
+        uint64_t repeating = held[w] & ~changed;
+        
+        while (changed) {
+            int key = w * 64 + lowest_bit(changed);
+            uint64_t bit = changed & (~changed + 1);
+            if (held[w] & bit) {
+                if (repressed & bit) add_frame_event(key, false, false);
+                add_frame_event(key, true, false);
+                key_repeat_frame[key] = frame_counter;
+            } else {
+                add_frame_event(key, false, false);
             }
+            changed &= changed - 1;
         }
-    }
-    
-    // Check if no keys are pressed - reset detection after delay
-    bool any_key_pressed = false;
-    for (int i = 0; i < num_keys; i++) {
-        if (tigrKeyDown(screen, keys_to_check[i]) || tigrKeyHeld(screen, keys_to_check[i])) {
-            any_key_pressed = true;
-            break;
+        
+        while (repeating) {
+            int key = w * 64 + lowest_bit(repeating);
+            if (frame_counter - key_repeat_frame[key] > 12) {  // ~12 frames = ~200ms at 60fps
+                add_frame_event(key, true, true);
+                key_repeat_frame[key] = frame_counter;
+            }
+            repeating &= repeating - 1;
         }
+        
+        key_held_bits[w] = held[w];
+        any_held = any_held || held[w] != 0;
     }
     
-    if (!any_key_pressed && frame_counter - last_key_time > 6) {  // ~6 frames = ~100ms
+    // "Last Key" fades ~6 frames (~100ms) after everything is released
+    if (any_held) {
+        last_key_time = frame_counter;
+    } else if (frame_counter - last_key_time > 6) {
         last_key_detected = 0;
     }
-    
-    return 0;
 }
 
-void update_graphics(void) {
-    if (!screen) return;
-    
-    // Beautiful gradient background
-    tigrClear(screen, tigrRGB(45, 55, 75));
-    
-    // PERFECTLY CENTERED text layout
-    int center_x = SCREEN_W / 2;
-    
-    // Main title - perfectly centered
-    const char* title = "Leroy's Piano System";
-    int title_width = strlen(title) * 6;  // tigr font is 6 pixels wide per char
-    tigrPrint(screen, tfont, center_x - title_width/2, 40, tigrRGB(255, 255, 255), title);
-    
-    // Subtitle - perfectly centered
-    const char* subtitle = "TeenyAT Assembly Platform";
-    int subtitle_width = strlen(subtitle) * 6;
-    tigrPrint(screen, tfont, center_x - subtitle_width/2, 65, tigrRGB(180, 180, 180), subtitle);
-    
-    // Instruction - perfectly centered
-    const char* instruction = "Press keys to play musical notes!";
-    int instruction_width = strlen(instruction) * 6;
-    tigrPrint(screen, tfont, center_x - instruction_width/2, 95, tigrRGB(150, 255, 150), instruction);
-    
-    // Show last key - perfectly centered
+int poll_key_events(KeyInputEvent *events, int max_events) {
+    int count = 0;
+    while (frame_event_read < frame_event_count && count < max_events) {
+        events[count++] = frame_events[frame_event_read++];
+    }
+    return count;
+}
+
+void inject_key(char key, bool pressed) {
+    int index = tolower((unsigned char)key);
+    uint64_t bit = 1ull << (index & 63);
+    if (pressed) {
+        injected_down[index >> 6] |= bit;
+        injected_held[index >> 6] |= bit;
+    } else {
+        injected_held[index >> 6] &= ~bit;
+    }
+}
+
+static void draw_last_key(void) {
+    // Back to the background first, the old line may have been wider
+    tigrBlit(screen, background, 0, LAST_KEY_Y, 0, LAST_KEY_Y, SCREEN_W, tigrTextHeight(tfont, "L"));
     if (last_key_detected != 0) {
         char msg[50];
         sprintf(msg, "Last Key: %c", last_key_detected);
-        int msg_width = strlen(msg) * 6;
-        tigrPrint(screen, tfont, center_x - msg_width/2, 120, tigrRGB(255, 255, 100), msg);
+        print_centered(screen, LAST_KEY_Y, tigrRGB(255, 255, 100), msg);
     }
-    
-    // Draw all keys with proper highlighting
-    for (int i = 0; i < keyCount; i++) {
-        TPixel keyColor, borderColor, textColor;
-        
-        if (keys[i].pressed) {
-            // HIGHLIGHTED state - use custom colors
-            keyColor = tigrRGB(keys[i].r, keys[i].g, keys[i].b);
-            borderColor = tigrRGB(255, 255, 255);
-            textColor = tigrRGB(0, 0, 0);
-        } else {
-            // NORMAL state
-            if (keys[i].is_piano) {
-                keyColor = tigrRGB(70, 80, 100);    // Piano keys (darker)
-                borderColor = tigrRGB(120, 130, 150);
-            } else {
-                keyColor = tigrRGB(50, 55, 65);     // Number keys (lighter)
-                borderColor = tigrRGB(90, 95, 105);
-            }
-            textColor = tigrRGB(220, 220, 220);
+    drawn_last_key = last_key_detected;
+}
+
+static void draw_key(Key *key) {
+    if (!key->pressed) {
+        tigrBlit(screen, background, key->x, key->y, key->x, key->y, key->w, key->h);
+        return;
+    }
+    if (!key->lit_sprite) key->lit_sprite = tigrBitmap(key->w, key->h);
+    if (key->lit_sprite_stale) {
+        render_key(key->lit_sprite, key, true, 0, 0);
+        key->lit_sprite_stale = false;
+    }
+    tigrBlit(screen, key->lit_sprite, key->x, key->y, 0, 0, key->w, key->h);
+}
+
+// Everything since the last frame: the whole screen after a full_redraw,
+// otherwise just the dirty keys and the last-key line
+static void draw_changes(void) {
+    if (full_redraw) {
+        tigrBlit(screen, background, 0, 0, 0, 0, SCREEN_W, SCREEN_H);
+        draw_last_key();
+        for (int i = 0; i < keyCount; i++) {
+            if (keys[i].pressed) draw_key(&keys[i]);
         }
-        
-        // Draw key background
-        tigrFill(screen, keys[i].x, keys[i].y, keys[i].w, keys[i].h, keyColor);
-        
-        // Draw key border
-        tigrRect(screen, keys[i].x, keys[i].y, keys[i].w, keys[i].h, borderColor);
-        
-        // Center text perfectly on key
-        int text_x = keys[i].x + (keys[i].w - 6) / 2;
-        int text_y = keys[i].y + (keys[i].h - 8) / 2;
-        tigrPrint(screen, tfont, text_x, text_y, textColor, keys[i].label);
+        full_redraw = false;
+        dirty_keys = 0;
+    } else {
+        if (drawn_last_key != last_key_detected) draw_last_key();
+        while (dirty_keys) {
+            draw_key(&keys[lowest_bit(dirty_keys)]);
+            dirty_keys &= dirty_keys - 1;
+        }
+    }
+}
+
+void graphics_draw_offscreen(bool full) {
+    if (!headless || !initialized) return;
+    if (!screen) {
+        screen = tigrBitmap(SCREEN_W, SCREEN_H);
+        build_background();
+        full_redraw = true;
+    }
+    if (full) full_redraw = true;
+    draw_changes();
+}
+
+void update_graphics(void) {
+    if (headless) {
+        // Nothing to draw, but frames still drive the keyboard snapshot
+        frame_counter++;
+        snapshot_keyboard();
+        return;
     }
+    if (!screen) return;
     
-    // Footer - perfectly centered
-    const char* footer = "Program sounds with TeenyAT assembly language!";
-    int footer_width = strlen(footer) * 6;
-    tigrPrint(screen, tfont, center_x - footer_width/2, SCREEN_H - 25, tigrRGB(120, 130, 140), footer);
+    TRACE_ZONE("draw", draw_changes());
     
-    tigrUpdate(screen);
+    // Called even when nothing was redrawn: tigrUpdate also pumps window
+    // messages and refreshes the keyboard state snapshot_keyboard() reads
+    TRACE_ZONE("tigrUpdate", tigrUpdate(screen));
+    frame_counter++;
+    snapshot_keyboard();
 }
\ No newline at end of file
@@ -11,6 +11,9 @@ extern "C" {
 void init_graphics(void);
 void cleanup_graphics(void);
 
+// No window: key state lives in memory and input comes from inject_key()
+void init_graphics_headless(void);
+
 // Graphics system status
 bool graphics_active(void);
 void update_graphics(void);
@@ -19,8 +22,26 @@ void update_graphics(void);
 void set_key_color(char keycode, int r, int g, int b);
 void set_key_pressed(char keycode, bool pressed);
 
-// Input functions
-char get_key_input(void);
+// Input functions - the keyboard is snapshotted once per update_graphics(),
+// these only read that snapshot
+
+// One key transition seen between two frames (keys are always lowercase)
+typedef struct {
+    char key;
+    bool pressed;       // true = went down, false = released
+    bool repeat;        // Auto-repeat of a key that stays held
+} KeyInputEvent;
+
+// Every press/release found by the last snapshot, in key order
+int poll_key_events(KeyInputEvent *events, int max_events);
+
+// Headless only: press or release a key; seen by the next update_graphics()
+void inject_key(char key, bool pressed);
+
+// Headless only, for bench: draw the frame into an off-screen bitmap with the
+// same code a window uses. full repaints everything, otherwise only the keys
+// and text that changed since the last call are drawn.
+void graphics_draw_offscreen(bool full);
 
 #ifdef __cplusplus
 }
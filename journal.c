@@ -0,0 +1,197 @@
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOURNAL_MAGIC "TNYJRNL1"
+#define JOURNAL_MAGIC_SIZE 8
+
+static FILE *record_file = NULL;
+static uint64_t record_last_cycle = 0;
+static uint32_t record_count = 0;
+
+struct Journal {
+    JournalEvent *events;
+    int count;
+    int next;
+};
+
+static void write_u32(FILE *file, uint32_t value) {
+    unsigned char bytes[4] = {
+        (unsigned char)value, (unsigned char)(value >> 8),
+        (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+    };
+    fwrite(bytes, 1, 4, file);
+}
+
+int journal_record_open(const char *path, double guest_mhz) {
+    record_file = fopen(path, "wb");
+    if (!record_file) {
+        printf("Error: Could not create journal %s\n", path);
+        return 0;
+    }
+    fwrite(JOURNAL_MAGIC, 1, JOURNAL_MAGIC_SIZE, record_file);
+    write_u32(record_file, (uint32_t)(guest_mhz * 1000.0 + 0.5));
+    record_last_cycle = 0;
+    record_count = 0;
+    return 1;
+}
+
+static int put_leb128(unsigned char *bytes, uint64_t value) {
+    int n = 0;
+    do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        bytes[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return n;
+}
+
+static uint64_t get_leb128(FILE *file, int *eof) {
+    uint64_t value = 0;
+    int shift = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        value |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+        if (!(c & 0x80) || shift > 63) break;
+    }
+    // Clean end of file only if nothing at all was read
+    *eof = c == EOF ? (shift == 0 ? 1 : -1) : 0;
+    return value;
+}
+
+void journal_record(uint64_t cycle, char key, uint8_t flags) {
+    if (!record_file) return;
+    
+    // Deltas are almost always a few bytes; stdio buffers the writes
+    unsigned char bytes[12];
+    int n = put_leb128(bytes, cycle - record_last_cycle);
+    bytes[n++] = (unsigned char)key;
+    bytes[n++] = flags;
+    fwrite(bytes, 1, n, record_file);
+    
+    record_last_cycle = cycle;
+    record_count++;
+}
+
+void journal_record_span(uint64_t cycle, uint8_t kind, uint64_t span) {
+    if (!record_file) return;
+    
+    unsigned char bytes[22];
+    int n = put_leb128(bytes, cycle - record_last_cycle);
+    bytes[n++] = 0;
+    bytes[n++] = kind;
+    n += put_leb128(bytes + n, span);
+    fwrite(bytes, 1, n, record_file);
+    
+    record_last_cycle = cycle;
+}
+
+void journal_record_close(void) {
+    if (!record_file) return;
+    fclose(record_file);
+    record_file = NULL;
+    printf("Journal: recorded %u key events\n", record_count);
+}
+
+int journal_recording(void) {
+    return record_file != NULL;
+}
+
+Journal *journal_load(const char *path, double *guest_mhz) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Error: Could not open journal %s\n", path);
+        return NULL;
+    }
+    
+    unsigned char header[JOURNAL_MAGIC_SIZE + 4];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE) != 0) {
+        printf("Error: %s is not an input journal\n", path);
+        fclose(file);
+        return NULL;
+    }
+    uint32_t khz = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+    *guest_mhz = khz / 1000.0;
+    
+    Journal *journal = (Journal *)calloc(1, sizeof(Journal));
+    if (!journal) {
+        printf("Error: Out of memory loading journal %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+    int capacity = 0;
+    uint64_t cycle = 0;
+    int truncated = 0;
+    
+    int keys = 0;
+    
+    for (;;) {
+        int eof;
+        uint64_t delta = get_leb128(file, &eof);
+        if (eof > 0) break;     // Clean end of file
+        
+        int key = fgetc(file);
+        int flags = fgetc(file);
+        uint64_t span = 0;
+        if (eof == 0 && flags != EOF && (flags & JOURNAL_RECORDS)) {
+            span = get_leb128(file, &eof);
+        }
+        if (eof != 0 || key == EOF || flags == EOF) {
+            truncated = 1;
+            break;
+        }
+        
+        if (journal->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            JournalEvent *events = (JournalEvent *)realloc(journal->events, capacity * sizeof(JournalEvent));
+            if (!events) {
+                printf("Error: Out of memory loading journal %s\n", path);
+                fclose(file);
+                journal_free(journal);
+                return NULL;
+            }
+            journal->events = events;
+        }
+        cycle += delta;
+        journal->events[journal->count].cycle = cycle;
+        journal->events[journal->count].key = (char)key;
+        journal->events[journal->count].flags = (uint8_t)flags;
+        journal->events[journal->count].span = span;
+        journal->count++;
+        if (!(flags & JOURNAL_RECORDS)) keys++;
+    }
+    fclose(file);
+    
+    printf("Journal %s: %d key events over %llu cycles (recorded at %.3f MHz)%s\n", path,
+           keys, (unsigned long long)journal_last_cycle(journal), khz / 1000.0,
+           truncated ? ", last event truncated" : "");
+    return journal;
+}
+
+void journal_free(Journal *journal) {
+    if (!journal) return;
+    free(journal->events);
+    free(journal);
+}
+
+const JournalEvent *journal_peek(const Journal *journal) {
+    if (journal->next >= journal->count) return NULL;
+    return &journal->events[journal->next];
+}
+
+void journal_advance(Journal *journal) {
+    if (journal->next < journal->count) journal->next++;
+}
+
+uint64_t journal_last_cycle(const Journal *journal) {
+    if (!journal->count) return 0;
+    const JournalEvent *last = &journal->events[journal->count - 1];
+    return last->cycle + ((last->flags & (JOURNAL_PARK | JOURNAL_WAIT)) ? last->span : 0);
+}
+
+int journal_done(const Journal *journal) {
+    return journal->next >= journal->count;
+}
@@ -0,0 +1,75 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Input journal: every key event the guest took off the key queue, stamped
+// with the guest cycle it was taken at. Replaying it hands the guest the
+// same events at the same cycles, independent of the host and the window.
+//
+// File: "TNYJRNL1", guest clock in kHz (u32 LE), then per event the cycle
+// delta from the previous event (LEB128), the key byte and a flags byte.
+// PARK, WAIT, DEPTH and OVERFLOW records have key 0 and are followed by
+// their span (LEB128).
+//
+// Guest time that passed without the guest running is journalled too, so a
+// replay reaches every event with the same instructions executed:
+//   PARK - the emulation thread parked on an idle guest; replay credits the
+//          span to bus_cycle_count before running cycle `cycle`
+//   WAIT - a blocking read (WAIT_KEY) waited that long on the host; replay
+//          hands the span back to the read at `cycle` (see bus_wait)
+//
+// Keys are replayed at the cycle the guest took them, so the replayed queue
+// is empty in between. What the guest saw of the queue is journalled instead:
+//   DEPTH, OVERFLOW - a GET_KEY_DEPTH / GET_KEY_OVERFLOW read at `cycle`
+//          returned `span`, which differs from the previous read of that
+//          port; replay returns it from that read on
+
+#define JOURNAL_PRESSED 0x01
+#define JOURNAL_REPEAT  0x02
+#define JOURNAL_PARK    0x04
+#define JOURNAL_WAIT    0x08
+#define JOURNAL_DEPTH   0x10
+#define JOURNAL_OVERFLOW 0x20
+// Records that aren't key events; all of them carry a span
+#define JOURNAL_RECORDS (JOURNAL_PARK | JOURNAL_WAIT | JOURNAL_DEPTH | JOURNAL_OVERFLOW)
+
+typedef struct {
+    uint64_t cycle;
+    char key;
+    uint8_t flags;      // JOURNAL_*
+    uint64_t span;      // Guest cycles (PARK, WAIT) or the value read (DEPTH, OVERFLOW)
+} JournalEvent;
+
+// Recording (emulation thread only)
+int journal_record_open(const char *path, double guest_mhz);
+void journal_record(uint64_t cycle, char key, uint8_t flags);
+void journal_record_span(uint64_t cycle, uint8_t kind, uint64_t span);     // One of JOURNAL_RECORDS
+void journal_record_close(void);
+int journal_recording(void);
+
+// Replay
+typedef struct Journal Journal;
+
+// NULL (after printing why) if the file is missing or not a journal.
+// *guest_mhz gets the clock the journal was recorded at (0 if unknown).
+Journal *journal_load(const char *path, double *guest_mhz);
+void journal_free(Journal *journal);
+
+// Next event in journal order, NULL once everything has been replayed.
+// journal_advance() consumes it.
+const JournalEvent *journal_peek(const Journal *journal);
+void journal_advance(Journal *journal);
+
+uint64_t journal_last_cycle(const Journal *journal);
+int journal_done(const Journal *journal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOURNAL_H
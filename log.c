@@ -0,0 +1,208 @@
+#include "log.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define LOG_RING_SIZE 1024              // Must be a power of two
+#define LOG_LINE_MAX 192                // Longer messages are truncated
+#define LOG_DRAIN_IDLE_NS 100000000     // Writer thread wakes at least this often when idle
+
+volatile unsigned char log_levels[LOG_CATEGORY_COUNT] = {
+    LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO
+};
+
+static const char *category_names[LOG_CATEGORY_COUNT] = { "sys", "bus", "audio", "keys" };
+static const char *level_names[] = { "off", "error", "warn", "info", "debug" };
+
+// Bounded multi-producer ring: producers claim a slot by bumping head, fill
+// it, then publish it through the slot's sequence number. Only the writer
+// thread consumes, so tail is a plain counter.
+typedef struct {
+    atomic_size_t sequence;
+    char text[LOG_LINE_MAX];
+} LogSlot;
+
+static LogSlot log_ring[LOG_RING_SIZE];
+static atomic_size_t log_head;
+static size_t log_tail;
+static atomic_uint log_dropped;
+static atomic_int log_running;
+static platform_thread *log_thread = NULL;
+
+// The writer sleeps on log_wake once the ring is empty. It sets log_idle
+// before its last look at the ring, and the first producer to publish after
+// that clears it and signals, so a message can't slip in unnoticed.
+static platform_event *log_wake = NULL;
+static atomic_int log_idle;
+
+static void log_ring_reset(void) {
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        atomic_init(&log_ring[i].sequence, i);
+    }
+}
+
+void log_write(log_category category, log_level level, const char *format, ...) {
+    (void)category;
+    (void)level;
+
+    if (!atomic_load_explicit(&log_running, memory_order_relaxed)) {
+        // No writer thread (startup, shutdown) - print straight away
+        char text[LOG_LINE_MAX];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        printf("%s\n", text);
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;) {
+        slot = &log_ring[head & (LOG_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence == head) {
+            if (atomic_compare_exchange_weak_explicit(&log_head, &head, head + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < head) {
+            // Writer is a full ring behind - drop rather than block the caller
+            atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            head = atomic_load_explicit(&log_head, memory_order_relaxed);
+        }
+    }
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->text, LOG_LINE_MAX, format, args);
+    va_end(args);
+
+    atomic_store_explicit(&slot->sequence, head + 1, memory_order_seq_cst);
+    if (atomic_load(&log_idle) && atomic_exchange(&log_idle, 0)) {
+        platform_event_signal(log_wake);
+    }
+}
+
+// Write out everything published so far, one fflush per batch
+static int log_drain(void) {
+    int written = 0;
+    for (;;) {
+        LogSlot *slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != log_tail + 1) break;
+
+        fputs(slot->text, stdout);
+        fputc('\n', stdout);
+        atomic_store_explicit(&slot->sequence, log_tail + LOG_RING_SIZE, memory_order_release);
+        log_tail++;
+        written++;
+    }
+
+    unsigned dropped = atomic_exchange_explicit(&log_dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        printf("(%u log messages dropped, ring full)\n", dropped);
+        written++;
+    }
+    if (written > 0) fflush(stdout);
+    return written;
+}
+
+static void log_thread_main(void *arg) {
+    (void)arg;
+    while (atomic_load_explicit(&log_running, memory_order_relaxed)) {
+        if (log_drain() > 0) continue;
+        atomic_store(&log_idle, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        // Published while we were setting the flag: no signal is coming for it
+        if (log_drain() > 0) {
+            atomic_store(&log_idle, 0);
+            continue;
+        }
+        platform_event_wait_ns(log_wake, LOG_DRAIN_IDLE_NS);
+        atomic_store(&log_idle, 0);
+    }
+}
+
+void log_init(void) {
+    if (log_thread) return;
+    log_ring_reset();
+    if (!log_wake) log_wake = platform_event_create();
+    atomic_store(&log_running, 1);
+    log_thread = platform_thread_start(log_thread_main, NULL);
+    if (!log_thread) {
+        atomic_store(&log_running, 0);
+        printf("Log: failed to start writer thread, logging synchronously\n");
+    }
+}
+
+void log_shutdown(void) {
+    atomic_store(&log_running, 0);
+    if (log_thread) {
+        platform_event_signal(log_wake);
+        platform_thread_join(log_thread);
+        log_thread = NULL;
+    }
+    log_drain();
+}
+
+// Case-insensitive match of text[0..length) against a lowercase name
+static int matches_name(const char *text, size_t length, const char *name) {
+    if (strlen(name) != length) return 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') c += 32;
+        if (c != name[i]) return 0;
+    }
+    return 1;
+}
+
+static int parse_level(const char *text, size_t length, unsigned char *level) {
+    for (int i = 0; i <= LOG_DEBUG; i++) {
+        if (matches_name(text, length, level_names[i])) {
+            *level = (unsigned char)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int log_configure(const char *spec) {
+    unsigned char levels[LOG_CATEGORY_COUNT];
+    memcpy(levels, (const void *)log_levels, sizeof(levels));
+
+    const char *item = spec;
+    while (*item) {
+        size_t length = strcspn(item, ",");
+        const char *colon = memchr(item, ':', length);
+        unsigned char level;
+
+        if (!colon) {
+            // Bare level: every category
+            if (!parse_level(item, length, &level)) return 0;
+            memset(levels, level, sizeof(levels));
+        } else {
+            size_t name_length = (size_t)(colon - item);
+            int category = -1;
+            for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+                if (matches_name(item, name_length, category_names[i])) {
+                    category = i;
+                }
+            }
+            if (category < 0) return 0;
+            if (!parse_level(colon + 1, length - name_length - 1, &level)) return 0;
+            levels[category] = level;
+        }
+
+        item += length;
+        if (*item == ',') item++;
+    }
+
+    for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+        log_levels[i] = levels[i];
+    }
+    return 1;
+}
@@ -0,0 +1,68 @@
+#ifndef LOG_H
+#define LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Leveled logging for the hot paths (bus handlers, audio commands, input).
+// LOG() formats into a lock-free ring and returns; a background thread
+// writes the ring to stdout, so the emulation thread never waits on the console.
+
+typedef enum {
+    LOG_SYS = 0,
+    LOG_BUS,
+    LOG_AUDIO,
+    LOG_KEYS,
+    LOG_CATEGORY_COUNT
+} log_category;
+
+typedef enum {
+    LOG_OFF = 0,
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} log_level;
+
+// Highest level printed per category (LOG_INFO by default)
+extern volatile unsigned char log_levels[LOG_CATEGORY_COUNT];
+
+// Start/stop the writer thread. Shutdown flushes whatever is still queued.
+void log_init(void);
+void log_shutdown(void);
+
+// "bus:warn,audio:info" - a bare level ("debug") applies to every category.
+// Returns 0 (and changes nothing) if the spec doesn't parse.
+int log_configure(const char *spec);
+
+// printf-style, no trailing newline needed. Use LOG() instead of calling this.
+void log_write(log_category category, log_level level, const char *format, ...);
+
+static inline int log_enabled(log_category category, log_level level) {
+    return level <= log_levels[category];
+}
+
+// Building with PIANO_LOG=0 (the default for NDEBUG builds) compiles every
+// LOG() away; the arguments are still type-checked but never evaluated.
+#ifndef PIANO_LOG
+#ifdef NDEBUG
+#define PIANO_LOG 0
+#else
+#define PIANO_LOG 1
+#endif
+#endif
+
+#if PIANO_LOG
+#define LOG(category, level, ...) \
+    do { if (log_enabled(category, level)) log_write(category, level, __VA_ARGS__); } while (0)
+#else
+#define LOG(category, level, ...) \
+    do { if (0) log_write(category, level, __VA_ARGS__); } while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_H
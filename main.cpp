@@ -1,434 +1,528 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
-#include <map>
-#include <set>
 #include <vector>
 #include <cstdio>
-#include <windows.h>
+#include <atomic>
+#include <thread>
+#include <csignal>
+#include <cmath>
 #include "../teenyat.h"
 #include "audio.h"
+#include "bus.h"
 #include "graphics.h"
+#include "log.h"
+#include "piano.h"
+#include "platform.h"
+#include "script.h"
+#include "journal.h"
+#include "trace.h"
 
 
 using namespace std;
 
-// Enhanced I/O Port addresses
-const tny_uword GET_KEY = 0x9000;           // Read key pressed
-const tny_uword PLAY_FREQUENCY = 0x9001;    // Play frequency/beep sound
-const tny_uword PLAY_WAV_ID = 0x9002;       // Play WAV file by ID
-const tny_uword SHOW_KEY = 0x9003;          // Visual feedback + sound
-const tny_uword SET_KEY_FREQ = 0x9004;      // Map key to frequency
-const tny_uword SET_KEY_WAV = 0x9005;       // Map key to WAV file
-const tny_uword SET_KEY_COLOR = 0x9006;     // Set key color
-const tny_uword GET_WAV_COUNT = 0x9007;     // Get number of WAV files
-const tny_uword LIST_WAVS = 0x9008;         // List available WAV files
-const tny_uword PLAY_COMBINED = 0x9009;     // Play frequency + WAV together
-const tny_uword SET_KEY_MODE = 0x900A;      // Set key audio mode
-const tny_uword PLAY_LETTER = 0x900B;       //
-
-// Enhanced piano state
-struct EnhancedPianoState {
-    char last_key_pressed = 0;
-    bool key_available = false;
-    char current_key_for_setup = 0;
-    
-    // Audio mappings
-    std::map<char, uint16_t> key_to_frequency;     // Key → frequency mapping
-    std::map<char, int> key_to_wav_id;             // Key → WAV file ID mapping
-    std::map<char, int> key_to_audio_mode;         // Key → audio mode (0=freq, 1=wav, 2=both)
-    std::map<char, int> key_to_wave_type;          // Key → waveform type for frequency
-    
-    // Visual mappings
-    std::map<char, uint32_t> key_to_color;         // Key → color mapping
-    std::map<char, int> key_highlight_timers;      // Key highlight timers
-    std::set<char> currently_highlighted;          // Currently highlighted keys
-    
-    // System state
-    int current_time = 0;
-} piano_state;
-
-void init_enhanced_piano_system() {
-    cout << "Initializing Enhanced Dual-Audio Piano System..." << endl;
-    /* Don't need default frequency mappings anymore
-    // Default frequency mappings (piano scale)
-    piano_state.key_to_frequency['q'] = 261;  // C4
-    piano_state.key_to_frequency['w'] = 277;  // C#4  
-    piano_state.key_to_frequency['e'] = 293;  // D4
-    piano_state.key_to_frequency['r'] = 311;  // D#4
-    piano_state.key_to_frequency['t'] = 329;  // E4
-    piano_state.key_to_frequency['y'] = 349;  // F4
-    piano_state.key_to_frequency['u'] = 369;  // F#4
-    piano_state.key_to_frequency['i'] = 391;  // G4
-    piano_state.key_to_frequency['o'] = 415;  // G#4
-    piano_state.key_to_frequency['p'] = 440;  // A4
-    
-    piano_state.key_to_frequency['a'] = 466;  // A#4
-    piano_state.key_to_frequency['s'] = 493;  // B4
-    piano_state.key_to_frequency['d'] = 523;  // C5
-    piano_state.key_to_frequency['f'] = 554;  // C#5
-    piano_state.key_to_frequency['g'] = 587;  // D5
-    piano_state.key_to_frequency['h'] = 622;  // D#5
-    piano_state.key_to_frequency['j'] = 659;  // E5
-    piano_state.key_to_frequency['k'] = 698;  // F5
-    piano_state.key_to_frequency['l'] = 740;  // F#5
-    
-    piano_state.key_to_frequency['z'] = 783;  // G5
-    piano_state.key_to_frequency['x'] = 831;  // G#5
-    piano_state.key_to_frequency['c'] = 880;  // A5  
-    piano_state.key_to_frequency['v'] = 932;  // A#5
-    piano_state.key_to_frequency['b'] = 988;  // B5
-    piano_state.key_to_frequency['n'] = 1047; // C6
-    piano_state.key_to_frequency['m'] = 1109; // C#6
-    
-    // Default audio modes (all start as frequency-based)
-    const char* keys = "qwertyuiopasdfghjklzxcvbnm";
-    for (int i = 0; keys[i]; i++) {
-        piano_state.key_to_audio_mode[keys[i]] = 0;  // 0 = frequency mode
-        piano_state.key_to_wave_type[keys[i]] = 0;   // 0 = sine wave
-    }*/
-    
-    // Initialize systems
-    init_graphics();
-    init_audio();
-    
-    cout << "WAV files available: " << get_sound_count() << endl;
-    if (get_sound_count() > 0) {
-        list_available_sounds();
-    }
-    
-    cout << "Enhanced Piano System Ready!" << endl;
-    cout << "Frequency support: (unlimited frequencies)" << endl;
-    cout << "WAV file support: " << (get_sound_count() > 0 ? "Yup" : "No") 
-         << " (" << get_sound_count() << " files)" << endl;
-    cout << "Color support:  (RGB332 format)" << endl;
-    cout << "Key mapping:  (26 keys available)" << endl;
-}
+// Emulation pacing defaults
+const double DEFAULT_GUEST_MHZ = 1.0;       // Guest clock target (--mhz)
+const int DEFAULT_FPS = 60;                 // Render/input rate (--fps)
+const uint64_t MAX_CATCHUP_NS = 100000000;  // Drop cycles we fall more than 100ms behind on
+const uint64_t EMU_SLICE_NS = 1000000;      // Emulation thread wakes every 1ms to run due cycles
+const uint64_t AUDIO_IDLE_NS = 100000000;   // Audio thread wakes at least this often with an empty queue
+const uint64_t IDLE_PARK_MAX_NS = 50000000; // Longest the emulation thread parks on an idle guest
+const unsigned DEFAULT_RENDER_RATE = 48000; // --render sample rate (--rate)
+const uint64_t RENDER_SLICE_FRAMES = 64;    // Audio commands land on this grid when rendering (~1.3ms)
+const uint64_t RENDER_TAIL_MAX_SEC = 10;    // Let notes ring out at most this long after the run
+
+static std::atomic<bool> emulator_running{false};
+
+// Time the emulation thread spent parked on an idle guest
+static uint64_t idle_parks = 0;
+static uint64_t idle_parked_ns = 0;
 
+// Bus stats (and the trace so far) on demand: SIGUSR1 (Ctrl+Break on Windows)
+// sets the flag and the render loop prints them, keeping stdio out of the
+// signal handler
+#ifdef _WIN32
+#define STATS_SIGNAL SIGBREAK
+#else
+#define STATS_SIGNAL SIGUSR1
+#endif
+static std::atomic<bool> stats_requested{false};
 
-void playLetterSound(char letter) {
-    if ((letter >= 'A' && letter <= 'Z') || (letter >= 'a' && letter <= 'z')) {
-        if (letter >= 'a' && letter <= 'z')
-            letter -= 32; // make uppercase
+static void request_stats(int) {
+    stats_requested = true;
+}
+
+static const char *trace_path = nullptr;    // --trace FILE
 
-        string path = "sounds/alphabet/";
-        path += letter;
-        path += ".wav";
+static void print_stats() {
+    bus_print_stats();
+    if (trace_path) trace_write(trace_path);
+}
 
-        cout << "[AutoSound] Attempting to play: " << path << endl;
+// Only polls that found commands to run become trace zones
+static bool run_audio_commands_traced() {
+    if (!trace_on) return run_pending_audio_commands();
+    uint64_t start = platform_time_ns();
+    bool ran = run_pending_audio_commands();
+    if (ran) trace_zone("audio commands", start, platform_time_ns());
+    return ran;
+}
 
-        cout << "[AutoSound] Found file: " << path << endl;
-        PlaySound(path.c_str(), NULL, SND_FILENAME | SND_ASYNC);
-    } else {
-        cout << "[AutoSound] Ignored key: " << (int)letter << endl;
+// Audio thread: plays queued sounds until the emulator stops, then drains what's left
+void audio_thread_main() {
+    trace_thread_name("audio commands");
+    while (emulator_running.load(std::memory_order_relaxed)) {
+        if (!run_audio_commands_traced()) {
+            wait_audio_commands(AUDIO_IDLE_NS);
+        }
     }
+    run_pending_audio_commands();
 }
 
+// One frame's input, windowed or headless: expire highlights, take key
+// events and publish the resulting key looks
+static void poll_input(uint64_t now_ns) {
+    update_piano_state(now_ns);
+    check_keyboard_input();
+    apply_key_visuals();
+}
 
-void check_keyboard_input() {
-    char key = get_key_input();
-    if (key != 0) {
-        piano_state.last_key_pressed = key;
-        piano_state.key_available = true;
-        
-        // Visual feedback
-        piano_state.key_highlight_timers[key] = 30;
-        piano_state.currently_highlighted.insert(key);
-        set_key_pressed(key, true);
-        set_key_color(key, 255, 255, 255);
-        
-        cout << "Key '" << key << "' pressed (ASCII " << (int)key << ")" << endl;
+// WAIT_KEY in a window: park the emulation thread until the render thread
+// queues a key (bus_wake), the timeout passes or the emulator stops
+static double host_wait_cycles_per_ns = 0.0;
 
-        // FOR ALPHABET KEYBOARD
-        
-        //playLetterSound(key);
+static uint64_t host_wait(uint64_t timeout_cycles, int (*ready)(void)) {
+    uint64_t start = platform_time_ns();
+    uint64_t deadline = timeout_cycles ? start + (uint64_t)(timeout_cycles / host_wait_cycles_per_ns) : UINT64_MAX;
+    while (!ready() && emulator_running.load(std::memory_order_relaxed)) {
+        uint64_t now = platform_time_ns();
+        if (now >= deadline) break;
+        bus_idle_wait(deadline - now < IDLE_PARK_MAX_NS ? deadline - now : IDLE_PARK_MAX_NS);
     }
+    uint64_t end = platform_time_ns();
+    if (trace_on) trace_zone("WAIT_KEY wait", start, end);
+    return (uint64_t)((end - start) * host_wait_cycles_per_ns);
 }
 
-void update_piano_state() {
-    piano_state.current_time++;
-    
-    // Update key highlight timers
-    for (auto it = piano_state.key_highlight_timers.begin(); 
-         it != piano_state.key_highlight_timers.end();) {
-        
-        it->second--;
-        
-        if (it->second <= 0) {
-            char key = it->first;
-            set_key_pressed(key, false);
-            piano_state.currently_highlighted.erase(key);
-            it = piano_state.key_highlight_timers.erase(it);
-        } else {
-            ++it;
+// Run the guest until `cycles_run` reaches `cycles_due`; returns the new count.
+// A blocking read credits the part of its wait that didn't fit in its delay.
+static uint64_t run_guest_until(teenyat *t, uint64_t cycles_run, uint64_t cycles_due) {
+    while (cycles_run < cycles_due) {
+        uint64_t before = bus_cycle_count;
+        tny_clock(t);
+        bus_cycle_count++;
+        cycles_run += bus_cycle_count - before;
+    }
+    return cycles_run;
+}
+
+// Emulation thread: run the guest in batches toward its target clock.
+// Wakes every EMU_SLICE_NS and executes every cycle that has come due.
+// When the guest is only spinning on an empty key port it parks instead,
+// until a key arrives (bus_wake) or IDLE_PARK_MAX_NS passes. The cycles it
+// would have spun are then credited to bus_cycle_count without running
+// them, so journal timestamps still follow the guest's clock.
+void emulation_thread_main(teenyat *t, double guest_mhz, bool idle_parking) {
+    const double cycles_per_ns = guest_mhz / 1000.0;
+    // Never less than one full bus stall, so a WAIT_KEY delay is always run off in one go
+    uint64_t max_batch = (uint64_t)(MAX_CATCHUP_NS * cycles_per_ns);
+    if (max_batch < 0x10000) max_batch = 0x10000;
+
+    host_wait_cycles_per_ns = cycles_per_ns;
+    bus_set_wait_handler(host_wait, (uint64_t)(guest_mhz * 1000000.0 + 0.5));
+    trace_thread_name("emulation");
+
+    uint64_t epoch = platform_time_ns();
+    uint64_t cycles_run = 0;
+
+    while (emulator_running.load(std::memory_order_relaxed)) {
+        uint64_t cycles_due = (uint64_t)((platform_time_ns() - epoch) * cycles_per_ns);
+        if (cycles_due > cycles_run + max_batch) {
+            // Host stalled (window drag, debugger...) - don't try to make up for it
+            cycles_run = cycles_due - max_batch;
+        }
+        TRACE_ZONE("guest", cycles_run = run_guest_until(t, cycles_run, cycles_due));
+
+        if (idle_parking && bus_guest_idle()) {
+            uint64_t park_start = platform_time_ns();
+            bus_idle_wait(IDLE_PARK_MAX_NS);
+            uint64_t now = platform_time_ns();
+            idle_parks++;
+            idle_parked_ns += now - park_start;
+            if (trace_on) trace_zone("idle park", park_start, now);
+
+            uint64_t due = (uint64_t)((now - epoch) * cycles_per_ns);
+            uint64_t skipped = due > cycles_run ? due - cycles_run : 0;
+            if (journal_recording()) journal_record_span(bus_cycle_count, JOURNAL_PARK, skipped);
+            cycles_run += skipped;
+            bus_cycle_count += skipped;
+            continue;
         }
+
+        platform_sleep_ns(EMU_SLICE_NS);
     }
+    bus_set_wait_handler(nullptr, 0);
 }
 
-// 🪄 Wrapper hook that watches for key events and plays alphabet sounds
-void monitor_keyboard_for_letters() {
-    // If a key has just been pressed, play its alphabet sound
-    if (piano_state.key_available) {
-        char letter = piano_state.last_key_pressed;
-        playLetterSound(letter);
-        piano_state.key_available = false; // mark as handled
+// What drives a headless run and when it ends
+struct HeadlessRun {
+    InputScript *script = nullptr;      // Keys through the keyboard snapshot, per frame
+    Journal *journal = nullptr;         // Keys straight onto the guest's queue, per cycle
+    uint64_t cycle_budget = 0;          // 0 = no limit
+    unsigned render_rate = 0;           // Non-zero: render audio offline at this sample rate
+};
+
+// The headless run in progress, for its wait handler
+static const HeadlessRun *headless_run = nullptr;
+static uint64_t headless_guest_hz = 0;
+
+// Rendering: run the sound commands queued so far, then mix up to the sample
+// that matches cycle
+static void mix_audio_to(uint64_t cycle) {
+    run_pending_audio_commands();
+    uint64_t frames = cycle * headless_run->render_rate / headless_guest_hz;
+    if (frames > audio_offline_frames()) {
+        audio_offline_render(frames - audio_offline_frames());
     }
 }
 
+static void render_audio_to(uint64_t cycle) {
+    if (!headless_run->render_rate) return;
+    TRACE_ZONE("render audio", mix_audio_to(cycle));
+}
 
-// Enhanced TeenyAT bus read callback
-void piano_bus_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay) {
-    *delay = 0;
-    
-    switch(addr) {
-        case GET_KEY:
-            check_keyboard_input();
-            if (piano_state.key_available) {
-                data->u = piano_state.last_key_pressed;
-                piano_state.key_available = false;
-                cout << "Assembly read key: '" << (char)data->u << "'" << endl;
-            } else {
-                data->u = 0;
-            }
-            break;
-            
-        case GET_WAV_COUNT:
-            data->u = get_sound_count();
-            cout << "Assembly read WAV count: " << data->u << endl;
+// WAIT_KEY headless: nothing can queue a key while the guest blocks this
+// thread, so jump virtual time straight to the next scripted event. A replay
+// takes the span the recording waited, then queues the keys it got.
+static uint64_t headless_wait(uint64_t timeout_cycles, int (*ready)(void)) {
+    const HeadlessRun &run = *headless_run;
+    const uint64_t start = bus_cycle_count;
+    render_audio_to(start);
+
+    if (run.journal) {
+        const JournalEvent *next = journal_peek(run.journal);
+        if (!next || !(next->flags & JOURNAL_WAIT) || next->cycle != start) return 0;
+        uint64_t span = next->span;
+        journal_advance(run.journal);
+        while ((next = journal_peek(run.journal)) && next->cycle <= start &&
+               !(next->flags & JOURNAL_RECORDS)) {
+            piano_replay_key(next->key, (next->flags & JOURNAL_PRESSED) != 0, (next->flags & JOURNAL_REPEAT) != 0);
+            journal_advance(run.journal);
+        }
+        return span;
+    }
+
+    uint64_t limit = timeout_cycles ? start + timeout_cycles : UINT64_MAX;
+    if (run.cycle_budget && limit > run.cycle_budget) limit = run.cycle_budget > start ? run.cycle_budget : start;
+    uint64_t now = start;
+    while (!ready()) {
+        uint64_t next = run.script ? input_script_next_cycle(run.script) : UINT64_MAX;
+        if (next == UINT64_MAX) {
+            // Out of input: the guest waits out the rest of the script, then gets 0
+            uint64_t end = run.script ? input_script_end_cycle(run.script) : 0;
+            if (end > limit) end = limit;
+            if (end > now) now = end;
             break;
-            
-        default:
-            data->u = 0;
+        }
+        if (next > limit) {
+            now = limit;
             break;
+        }
+        if (next > now) now = next;
+
+        ScriptEvent event;
+        while (input_script_next(run.script, now, &event)) {
+            inject_key(event.key, event.pressed != 0);
+        }
+        update_graphics();
+        check_keyboard_input();
     }
+    return now - start;
 }
 
-// Enhanced TeenyAT bus write callback  
-void piano_bus_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay) {
-    *delay = 0;
-    
-    switch(addr) {
-        case PLAY_FREQUENCY:
-            {
-                // Format: [wave_type:4][duration:4][frequency:8]
-                int frequency_code = data.u & 0xFF;           // Bottom 8 bits
-                int duration_code = (data.u >> 8) & 0xF;      // Next 4 bits  
-                int wave_type = (data.u >> 12) & 0xF;         // Top 4 bits
-                
-                // Map frequency code to actual frequency
-                int actual_freq = 220 + (frequency_code * 10); // 220Hz to 2770Hz range
-                float duration = 0.1f + (duration_code * 0.1f); // 0.1s to 1.6s
-                
-                cout << "PLAY_FREQUENCY: " << actual_freq << "Hz, " 
-                     << duration << "s, wave_type=" << wave_type << endl;
-                
-                play_tone_with_type(actual_freq, wave_type, duration);
-            }
-            break;
-            
-        case PLAY_WAV_ID:
-            {
-                int wav_id = data.u;
-                cout << "PLAY_WAV_ID: " << wav_id;
-                if (wav_id < get_sound_count()) {
-                    cout << " (" << get_sound_name_by_id(wav_id) << ")" << endl;
-                    play_wav_file_by_id(wav_id);
-                } else {
-                    cout << " (INVALID - max " << (get_sound_count()-1) << ")" << endl;
-                    play_beep(440); // Error beep
-                }
-            }
-            break;
-        case PLAY_LETTER:
-            {
-                char key = (char)data.u;
-                cout << "SHOW_KEY: '" << key << "'" << endl;
-                if (key!=0) {
-                    playLetterSound(key);
-                }
-            }
-        case SHOW_KEY:
-            {
-                char key = (char)data.u;
-                cout << "SHOW_KEY: '" << key << "'" << endl;
-                
-                // Visual feedback
-                piano_state.key_highlight_timers[key] = 50;
-                piano_state.currently_highlighted.insert(key);
-                set_key_pressed(key, true);
-                
-                // Apply custom color if set
-                int r = 255, g = 255, b = 255;
-                const char* color_name = "White";
-                
-                if (piano_state.key_to_color.find(key) != piano_state.key_to_color.end()) {
-                    uint32_t color_val = piano_state.key_to_color[key];
-                    r = ((color_val >> 5) & 0x07) * 36;  // Extract red (3 bits)
-                    g = ((color_val >> 2) & 0x07) * 36;  // Extract green (3 bits)  
-                    b = (color_val & 0x03) * 85;         // Extract blue (2 bits)
-                    color_name = "Custom";
-                }
-                
-                set_key_color(key, r, g, b);
-                cout << "Color: " << color_name << " RGB(" << r << "," << g << "," << b << ")" << endl;
-                
-                // Play sound based on key's audio mode
-                int audio_mode = 0; // Default to frequency
-                if (piano_state.key_to_audio_mode.find(key) != piano_state.key_to_audio_mode.end()) {
-                    audio_mode = piano_state.key_to_audio_mode[key];
-                }
-                
-                switch(audio_mode) {
-                    case 0: // Frequency mode
-                        if (piano_state.key_to_frequency.find(key) != piano_state.key_to_frequency.end()) {
-                            int freq = piano_state.key_to_frequency[key];
-                            int wave_type = piano_state.key_to_wave_type[key];
-                            cout << "Playing frequency: " << freq << "Hz (wave_type=" << wave_type << ")" << endl;
-                            play_tone_with_type(freq, wave_type, 0.3f);
-                        }
-                        break;
-                        
-                    case 1: // WAV mode
-                        if (piano_state.key_to_wav_id.find(key) != piano_state.key_to_wav_id.end()) {
-                            int wav_id = piano_state.key_to_wav_id[key];
-                            cout << "Playing WAV: " << get_sound_name_by_id(wav_id) << endl;
-                            play_wav_file_by_id(wav_id);
-                        }
-                        break;
-                        
-                    case 2: // Both frequency + WAV
-                        if (piano_state.key_to_frequency.find(key) != piano_state.key_to_frequency.end() &&
-                            piano_state.key_to_wav_id.find(key) != piano_state.key_to_wav_id.end()) {
-                            int freq = piano_state.key_to_frequency[key];
-                            int wav_id = piano_state.key_to_wav_id[key];
-                            cout << "Playing BOTH: " << freq << "Hz + " << get_sound_name_by_id(wav_id) << endl;
-                            play_sound_mixed(freq, wav_id, 0.3f);
-                        }
-                        break;
-                }
-            }
-            break;
-            
-        case SET_KEY_FREQ:
-            // First call selects key, second call sets frequency
-            if (piano_state.current_key_for_setup == 0) {
-                piano_state.current_key_for_setup = (char)data.u;
-                cout << "Selected key '" << piano_state.current_key_for_setup << "' for configuration" << endl;
-            } else {
-                piano_state.key_to_frequency[piano_state.current_key_for_setup] = data.u;
-                cout << "Set key '" << piano_state.current_key_for_setup 
-                     << "' frequency to " << data.u << "Hz" << endl;
-                piano_state.current_key_for_setup = 0; // Reset selection
-            }
-            break;
-            
-        case SET_KEY_WAV:
-            if (piano_state.current_key_for_setup != 0) {
-                if (data.u < get_sound_count()) {
-                    piano_state.key_to_wav_id[piano_state.current_key_for_setup] = data.u;
-                    cout << "Set key '" << piano_state.current_key_for_setup 
-                         << "' WAV to " << data.u << " (" << get_sound_name_by_id(data.u) << ")" << endl;
-                } else {
-                    cout << "Invalid WAV ID " << data.u << " for key '" 
-                         << piano_state.current_key_for_setup << "'" << endl;
-                }
-                piano_state.current_key_for_setup = 0; // Reset selection
-            } else {
-                cout << "No key selected for WAV mapping" << endl;
-            }
-            break;
-            
-        case SET_KEY_COLOR:
-            if (piano_state.current_key_for_setup != 0) {
-                piano_state.key_to_color[piano_state.current_key_for_setup] = data.u & 0xFF;
-                
-                int r = ((data.u >> 5) & 0x07) * 36;
-                int g = ((data.u >> 2) & 0x07) * 36;  
-                int b = (data.u & 0x03) * 85;
-                
-                cout << "Set key '" << piano_state.current_key_for_setup 
-                     << "' color to RGB(" << r << "," << g << "," << b << ") [0x" 
-                     << hex << (data.u & 0xFF) << dec << "]" << endl;
-                piano_state.current_key_for_setup = 0; // Reset selection
+// Guest time of a cycle count. Split into whole seconds and the rest, since
+// cycles * 1e9 overflows 64 bits after ~1.8e10 cycles (76 min at 4 MHz)
+static uint64_t cycles_to_ns(uint64_t cycles, uint64_t hz) {
+    return cycles / hz * 1000000000ull + cycles % hz * 1000000000ull / hz;
+}
+
+// One headless frame of guest time, in audio-slice steps. Returns the new
+// cycle count (at least frame_end, more if a replayed park overshoots it).
+static uint64_t run_headless_frame(teenyat *t, const HeadlessRun &run, uint64_t cycles_run,
+                                   uint64_t frame_end, uint64_t slice_cycles) {
+    uint64_t slice_end = cycles_run;
+    while (cycles_run < frame_end) {
+        // Replay what the recording saw before this cycle: keys are queued,
+        // parks credited, queue depth/overflow values set, and a WAIT is
+        // left for the WAIT_KEY read at its cycle to pick up
+        const JournalEvent *next;
+        while (run.journal && (next = journal_peek(run.journal)) && next->cycle <= cycles_run) {
+            if (next->flags & JOURNAL_WAIT) {
+                if (next->cycle == cycles_run) break;
+                LOG(LOG_SYS, LOG_WARN, "Replay diverged: no WAIT_KEY read at cycle %llu",
+                    (unsigned long long)next->cycle);
+            } else if (next->flags & JOURNAL_PARK) {
+                bus_cycle_count += next->span;
+                cycles_run = bus_cycle_count;
+            } else if (next->flags & (JOURNAL_DEPTH | JOURNAL_OVERFLOW)) {
+                piano_replay_queue_state(next->flags & (JOURNAL_DEPTH | JOURNAL_OVERFLOW), (uint16_t)next->span);
             } else {
-                cout << "No key selected for color mapping" << endl;
-            }
-            break;
-            
-        case SET_KEY_MODE:
-            // Format: [key:8][mode:4][wave_type:4]
-            {
-                char key = (char)(data.u & 0xFF);
-                int mode = (data.u >> 8) & 0xF;
-                int wave_type = (data.u >> 12) & 0xF;
-                
-                piano_state.current_key_for_setup = key; // Auto-select key
-                piano_state.key_to_audio_mode[key] = mode;
-                piano_state.key_to_wave_type[key] = wave_type;
-                
-                const char* mode_names[] = {"Frequency", "WAV", "Both", "Reserved"};
-                cout << "Set key '" << key << "' mode to " << mode_names[mode % 4] 
-                     << " (wave_type=" << wave_type << ")" << endl;
+                piano_replay_key(next->key, (next->flags & JOURNAL_PRESSED) != 0,
+                                 (next->flags & JOURNAL_REPEAT) != 0);
             }
+            journal_advance(run.journal);
+        }
+
+        if (cycles_run >= slice_end) {
+            slice_end = cycles_run + slice_cycles;
+            if (slice_end > frame_end) slice_end = frame_end;
+        }
+        // Stopping early for a journal event doesn't end the slice, so
+        // audio lands on the same grid as in the recorded run
+        uint64_t run_to = slice_end;
+        if (run.journal && (next = journal_peek(run.journal))) {
+            // A WAIT needs its own cycle to run
+            uint64_t due = next->cycle + ((next->flags & JOURNAL_WAIT) ? 1 : 0);
+            if (due < run_to) run_to = due;
+        }
+
+        while (cycles_run < run_to) {
+            tny_clock(t);
+            cycles_run = ++bus_cycle_count;
+        }
+        if (cycles_run >= slice_end) render_audio_to(cycles_run);
+    }
+    return cycles_run;
+}
+
+// Headless: no window and no wall clock. The guest runs flat out on this
+// thread in frame-sized slices of virtual time; scripted keys are injected
+// between slices, so the same script always gives the same run. Journal
+// events are queued exactly at the cycle they were recorded at.
+// WAIT_KEY reads don't burn cycles here either: see headless_wait.
+// With render_rate set there is no audio thread either: sound commands run
+// here every RENDER_SLICE_FRAMES and the mixer is advanced to the matching
+// sample, which makes the rendered WAV bit-identical from run to run.
+// Returns the number of guest cycles executed.
+uint64_t run_headless(teenyat *t, double guest_mhz, int fps, const HeadlessRun &run) {
+    const uint64_t guest_hz = (uint64_t)(guest_mhz * 1000000.0 + 0.5);
+    const uint64_t frame_cycles = guest_hz / fps + 1;
+    const uint64_t slice_cycles = run.render_rate ? RENDER_SLICE_FRAMES * guest_hz / run.render_rate + 1 : frame_cycles;
+    uint64_t cycles_run = bus_cycle_count;
+    bool final_frame = false;
+
+    headless_run = &run;
+    headless_guest_hz = guest_hz;
+    bus_set_wait_handler(headless_wait, guest_hz);
+
+    while (emulator_running.load(std::memory_order_relaxed)) {
+        TRACE_ZONE("input", poll_input(cycles_to_ns(cycles_run, guest_hz)));
+
+        uint64_t frame_end = cycles_run + frame_cycles;
+        if (run.cycle_budget && frame_end > run.cycle_budget) frame_end = run.cycle_budget;
+        TRACE_ZONE("guest frame", cycles_run = run_headless_frame(t, run, cycles_run, frame_end, slice_cycles));
+
+        ScriptEvent event;
+        while (run.script && input_script_next(run.script, cycles_run, &event)) {
+            inject_key(event.key, event.pressed != 0);
+        }
+        update_graphics();
+
+        if (stats_requested.exchange(false)) {
+            print_stats();
+        }
+
+        if (run.cycle_budget && cycles_run >= run.cycle_budget) {
+            cout << "Cycle budget reached" << endl;
             break;
-            
-        case PLAY_COMBINED:
-            // Format: [wav_id:8][frequency_code:8]
-            {
-                int frequency_code = data.u & 0xFF;
-                int wav_id = (data.u >> 8) & 0xFF;
-                int actual_freq = 220 + (frequency_code * 10);
-                
-                cout << "PLAY_COMBINED: " << actual_freq << "Hz + WAV " << wav_id << endl;
-                play_sound_mixed(actual_freq, wav_id, 0.5f);
+        }
+        bool input_done = run.script ? input_script_done(run.script) && cycles_run >= input_script_end_cycle(run.script)
+                        : run.journal ? journal_done(run.journal)
+                        : false;
+        if (input_done) {
+            // One more frame so the guest gets to see the last events
+            if (final_frame) {
+                cout << (run.script ? "Script finished" : "Replay finished") << endl;
+                break;
             }
-            break;
-            
-        case LIST_WAVS:
-            cout << "=== Assembly requested WAV list ===" << endl;
-            list_available_sounds();
-            cout << "=== End of WAV list ===" << endl;
-            break;
-            
-        default:
-            cout << "Unknown I/O address: 0x" << hex << addr << dec << endl;
-            break;
+            final_frame = true;
+        }
     }
+
+    if (run.render_rate) {
+        run_pending_audio_commands();
+        uint64_t tail = 0;
+        while (audio_voices_active() && tail < RENDER_TAIL_MAX_SEC * run.render_rate) {
+            audio_offline_render(RENDER_SLICE_FRAMES);
+            tail += RENDER_SLICE_FRAMES;
+        }
+    }
+    bus_set_wait_handler(nullptr, 0);
+    headless_run = nullptr;
+    return cycles_run;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
+    const char *bin_path = NULL;
+    double guest_mhz = DEFAULT_GUEST_MHZ;
+    bool mhz_given = false;
+    int fps = DEFAULT_FPS;
+    bool bad_args = false;
+    bool headless = false;
+    const char *script_path = NULL;
+    uint64_t cycle_budget = 0;
+    const char *render_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    bool idle_parking = true;
+    bool bus_latency = false;
+    unsigned render_rate = DEFAULT_RENDER_RATE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mhz") == 0 && i + 1 < argc) {
+            guest_mhz = atof(argv[++i]);
+            mhz_given = true;
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-idle") == 0) {
+            idle_parking = false;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script_path = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            render_path = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            render_rate = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycle_budget = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--bus-latency") == 0) {
+            bus_latency = true;
+        } else if (strncmp(argv[i], "--log=", 6) == 0) {
+            if (!log_configure(argv[i] + 6)) {
+                cout << "Bad --log spec: " << argv[i] + 6 << endl;
+                bad_args = true;
+            }
+        } else if (!bin_path) {
+            bin_path = argv[i];
+        }
+    }
+
+    piano_register_ports();
+    bus_register_stats_ports();
+
+    // Headless runs have nothing that closes them, so they need an end
+    if (headless && !script_path && !replay_path && !cycle_budget) {
+        cout << (render_path ? "--render" : "--headless")
+             << " needs --script, --replay or --cycles to know when to stop" << endl;
+        bad_args = true;
+    }
+    if (script_path && replay_path) {
+        cout << "--script and --replay can't be combined" << endl;
+        bad_args = true;
+    }
+
+    if (!bin_path || guest_mhz <= 0.0 || fps <= 0 || render_rate == 0 || bad_args) {
         cout << "Enhanced Dual-Audio Piano System for TeenyAT" << endl;
-        cout << "Usage: " << argv[0] << " <assembly_program.bin>" << endl;
+        cout << "Usage: " << argv[0] << " <assembly_program.bin> [--mhz N] [--fps N] [--log=SPEC]" << endl;
+        cout << "       " << argv[0] << " <assembly_program.bin> --headless [--script FILE] [--cycles N]" << endl;
+        cout << "       " << argv[0] << " <assembly_program.bin> --replay FILE [--cycles N] [--render OUT.wav]" << endl;
+        cout << "       " << argv[0] << " <assembly_program.bin> --render OUT.wav [--rate N] [--script FILE] [--cycles N]" << endl;
+        cout << "  --mhz N   guest clock rate in MHz (default " << DEFAULT_GUEST_MHZ << ")" << endl;
+        cout << "  --fps N   render/input rate in frames per second, e.g. 30/60/120 (default " << DEFAULT_FPS << ")" << endl;
+        cout << "  --no-idle keep running the guest while it only polls for keys (default: park the host thread)" << endl;
+        cout << "  --log=SPEC  log levels, e.g. bus:warn,audio:info or debug" << endl;
+        cout << "              (categories sys/bus/audio/keys, levels off/error/warn/info/debug)" << endl;
+        cout << "  --headless    no window, silent audio, guest runs as fast as it can" << endl;
+        cout << "                needs --script, --replay or --cycles to know when to stop" << endl;
+        cout << "  --script FILE key events for headless runs (implies --headless), see script.h" << endl;
+        cout << "  --cycles N    headless: stop after N guest cycles" << endl;
+        cout << "  --record FILE journal every key event the guest reads, with its guest cycle" << endl;
+        cout << "  --replay FILE feed a journal back at the same cycles, full speed (implies --headless)" << endl;
+        cout << "                the guest clock defaults to the journal's, --mhz overrides it" << endl;
+        cout << "  --render FILE write the session's audio to a WAV file, faster than real time (implies --headless)" << endl;
+        cout << "  --rate N      --render sample rate in Hz (default " << DEFAULT_RENDER_RATE << ")" << endl;
+        cout << "  --trace FILE  record emulation/audio/render timings as Chrome trace JSON" << endl;
+        cout << "                (open in chrome://tracing or ui.perfetto.dev)" << endl;
+        cout << "  --bus-latency time every I/O port handler for the bus stats (on with --trace)" << endl;
+        cout << "Bus stats (and --trace) print at exit, or on SIGUSR1 (Ctrl+Break on Windows)" << endl;
         cout << endl;
         cout << "Enhanced I/O Ports:" << endl;
-        cout << "  0x9000 - GET_KEY (read keyboard input)" << endl;
-        cout << "  0x9001 - PLAY_FREQUENCY (play frequency/beep with wave type)" << endl;
-        cout << "  0x9002 - PLAY_WAV_ID (play WAV file by ID)" << endl;
-        cout << "  0x9003 - SHOW_KEY (visual + audio feedback)" << endl;
-        cout << "  0x9004 - SET_KEY_FREQ (map key to frequency)" << endl;
-        cout << "  0x9005 - SET_KEY_WAV (map key to WAV file)" << endl;
-        cout << "  0x9006 - SET_KEY_COLOR (set key color RGB332)" << endl;
-        cout << "  0x9007 - GET_WAV_COUNT (read number of WAV files)" << endl;
-        cout << "  0x9008 - LIST_WAVS (display available WAV files)" << endl;
-        cout << "  0x9009 - PLAY_COMBINED (play frequency + WAV together)" << endl;
-        cout << "  0x900A - SET_KEY_MODE (set key audio mode)" << endl;
+        bus_print_ports();
         return 1;
     }
     
     // Open binary file
-    FILE *bin_file = fopen(argv[1], "rb");
+    FILE *bin_file = fopen(bin_path, "rb");
     if (!bin_file) {
-        cout << "Error: Could not open file " << argv[1] << endl;
+        cout << "Error: Could not open file " << bin_path << endl;
+        return 1;
+    }
+
+    HeadlessRun run;
+    run.cycle_budget = cycle_budget;
+    run.render_rate = render_path ? render_rate : 0;
+    if (script_path) {
+        run.script = input_script_load(script_path, guest_mhz);
+        if (!run.script) {
+            fclose(bin_file);
+            return 1;
+        }
+    }
+    if (replay_path) {
+        double recorded_mhz;
+        run.journal = journal_load(replay_path, &recorded_mhz);
+        if (!run.journal) {
+            fclose(bin_file);
+            return 1;
+        }
+        piano_replay_begin();
+        // Cycles replay the same at any clock, but sample positions,
+        // highlight times and WAIT_KEY_TIMEOUT are converted with it
+        if (recorded_mhz > 0.0 && !mhz_given) {
+            guest_mhz = recorded_mhz;
+        } else if (recorded_mhz > 0.0 && fabs(guest_mhz - recorded_mhz) >= 0.0005) {
+            cout << "Warning: replaying at " << guest_mhz << " MHz, journal was recorded at "
+                 << recorded_mhz << " MHz; audio and key timing will not match the session" << endl;
+        }
+    }
+    if (record_path && !journal_record_open(record_path, guest_mhz)) {
+        fclose(bin_file);
+        return 1;
+    }
+
+    // Before the sound bank loads, so its decode threads show up too
+    if (trace_path) {
+        if (!trace_start()) trace_path = nullptr;
+        trace_thread_name(headless ? "main" : "render");
+    }
+    // Slow handlers show up as trace zones, so tracing needs them timed
+    bus_set_latency_timing(bus_latency || trace_path);
+
+    // Offline audio goes in first; init_enhanced_piano_system() then finds
+    // audio already initialized and leaves it alone
+    if (render_path && !init_audio_offline(render_path, render_rate)) {
+        fclose(bin_file);
+        input_script_free(run.script);
+        journal_free(run.journal);
         return 1;
     }
 
     // Initialize enhanced system
-    init_enhanced_piano_system();
+    init_enhanced_piano_system(headless);
 
     // Initialize TeenyAT
     teenyat t;
-    bool init_success = tny_init_from_file(&t, bin_file, piano_bus_read, piano_bus_write);
+    bool init_success = tny_init_from_file(&t, bin_file, bus_read, bus_write);
     fclose(bin_file);
     
     if (!init_success) {
@@ -436,19 +530,75 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    cout << "Starting Enhanced Dual-Audio Piano with " << argv[1] << endl;
+    cout << "Starting Enhanced Dual-Audio Piano with " << bin_path << endl;
+    cout << "Guest clock: " << guest_mhz << " MHz, render rate: " << fps << " fps" << endl;
     cout << "Assembly programmers can now use frequencies AND WAV files!" << endl << endl;
 
-    // Main execution loop
-    while (graphics_active()) {
-        tny_clock(&t);
-        update_piano_state();
-        update_graphics();
+    log_init();
+    emulator_running = true;
+    std::thread audio_thread;
+    if (!render_path) {
+        audio_thread = std::thread(audio_thread_main);
+    }
+    signal(STATS_SIGNAL, request_stats);
 
-        // monitor_keyboard_for_letters();
-        
+    if (headless) {
+        uint64_t start = platform_time_ns();
+        uint64_t cycles = run_headless(&t, guest_mhz, fps, run);
+        double seconds = (platform_time_ns() - start) / 1e9;
+        cout << "Headless run: " << cycles << " cycles in " << seconds << " s ("
+             << (seconds > 0 ? cycles / seconds / 1e6 : 0.0) << " MHz effective)" << endl;
+        if (render_path) {
+            double audio_seconds = (double)audio_offline_frames() / render_rate;
+            cout << "Rendered " << audio_seconds << " s of audio to " << render_path << " ("
+                 << (seconds > 0 ? audio_seconds / seconds : 0.0) << "x real time)" << endl;
+        }
+        input_script_free(run.script);
+        journal_free(run.journal);
+    }
+
+    // The guest runs on its own thread, sounds play on the audio thread and
+    // this (window-owning) thread handles input and rendering.
+    std::thread emu_thread;
+    if (!headless) {
+        emu_thread = std::thread(emulation_thread_main, &t, guest_mhz, idle_parking);
+    }
+
+    const uint64_t frame_ns = 1000000000ull / fps;
+    uint64_t next_frame = platform_time_ns();
+
+    while (!headless && graphics_active()) {
+        TRACE_ZONE("input", poll_input(platform_time_ns()));
+        update_graphics();
         
-        for (volatile int i = 0; i < 1000; i++);
+        if (stats_requested.exchange(false)) {
+            print_stats();
+        }
+
+        next_frame += frame_ns;
+        uint64_t now = platform_time_ns();
+        if (next_frame > now) {
+            platform_sleep_ns(next_frame - now);
+        } else {
+            next_frame = now;
+        }
+    }
+
+    emulator_running = false;
+    bus_wake();
+    wake_audio_commands();
+    if (emu_thread.joinable()) emu_thread.join();
+    if (audio_thread.joinable()) audio_thread.join();
+    journal_record_close();
+    log_shutdown();
+    print_stats();
+    if (idle_parks > 0) {
+        cout << "Idle: parked " << idle_parks << " times, " << idle_parked_ns / 1e9 << " s" << endl;
+    }
+
+    uint32_t dropped = piano_dropped_commands();
+    if (dropped > 0) {
+        cout << "Dropped " << dropped << " commands (queue full)" << endl;
     }
 
     cleanup_graphics();
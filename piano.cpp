@@ -0,0 +1,815 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "../teenyat.h"
+#include "piano.h"
+#include "audio.h"
+#include "bus.h"
+#include "graphics.h"
+#include "journal.h"
+#include "log.h"
+#include "platform.h"
+#include "seqlock.h"
+#include "spsc_ring.h"
+
+
+using namespace std;
+
+// GET_KEY_EVENT format: [released:1][unused:7][key:8], 0 = no event
+const tny_uword KEY_EVENT_RELEASED = 0x8000;
+
+// Highlight durations in ms of piano clock (see update_piano_state);
+// HIGHLIGHT_HELD keeps a key lit until it is released
+const int HIGHLIGHT_HELD = -1;
+const int HIGHLIGHT_SHOW_MS = 800;
+const int HIGHLIGHT_RELEASE_MS = 100;
+
+// Highlight expiry goes through a timer wheel: each slot is a key bitset for
+// the deadlines that fall in one 2^24 ns (~16.8ms) tick, so a frame only
+// visits the slots it advanced over. Deadlines more than one turn away stay
+// in their slot and are skipped until their turn comes round.
+const int WHEEL_TICK_SHIFT = 24;
+const int WHEEL_SLOTS = 64;
+const uint64_t NO_DEADLINE = UINT64_MAX;
+
+// Sound commands produced by the bus callbacks on the emulation thread and
+// drained by the audio thread, so a bus write never waits on Beep() or miniaudio.
+enum class PianoCommandType : uint8_t {
+    PlayTone,       // frequency, wave_type, duration
+    PlayWav,        // wav_id
+    PlayMixed,      // frequency, wav_id, duration
+    PlayLetter,     // key
+    NoteOn,         // key, frequency, wave_type
+    NoteOff,        // key
+};
+
+struct PianoCommand {
+    PianoCommandType type;
+    char key;
+    int frequency;
+    int wave_type;
+    int wav_id;
+    float duration;
+};
+
+static SpscRing<PianoCommand, 1024> audio_commands;    // emulation -> audio thread
+static platform_event *audio_commands_ready = nullptr;  // Signalled on every push
+static std::atomic<uint32_t> dropped_commands{0};
+
+// What the guest asked each key to look like, published by the emulation
+// thread and read by the render thread once per frame. It is state rather
+// than a queue, so it can't overflow and neither side waits on the other.
+// One word per key: [shows:32][r:8][g:8][b:8][flags:8]. shows counts
+// SHOW_KEY/NOTE_ON, so a key shown again between two frames is still seen.
+enum : uint8_t {
+    KEY_VISUAL_NOTE = 1 << 0,   // Last show was NOTE_ON (lit until released)
+    KEY_VISUAL_HELD = 1 << 1,   // ...and no NOTE_OFF since
+};
+static SeqlockArray<256> key_visuals;
+
+// Key events travel from the render thread (which owns the window) to the
+// emulation thread, where GET_KEY drains them in order. Nothing gets
+// overwritten between two guest reads; if the guest falls KEY_QUEUE_SIZE
+// events behind, new ones are counted as overflow instead.
+const size_t KEY_QUEUE_SIZE = 64;
+
+struct KeyEvent {
+    char key;
+    bool pressed;               // false = released
+    bool repeat;                // Auto-repeat of a held key (GET_KEY only)
+    uint64_t timestamp_ns;      // Host time the render thread saw the key
+};
+
+static SpscRing<KeyEvent, KEY_QUEUE_SIZE> key_events;
+static std::atomic<uint16_t> key_overflow{0};
+
+// What the guest saw of the queue through GET_KEY_DEPTH/GET_KEY_OVERFLOW.
+// Recording journals each change; a replay queues keys only at the cycle
+// they were taken, so it answers these reads from the journal instead.
+struct QueueView {
+    uint16_t depth = 0;
+    uint16_t overflow = 0;
+};
+static QueueView recorded_view;         // Last values journalled
+static QueueView replay_view;           // Values the replay is at
+static bool replaying = false;
+
+static tny_uword observe_queue(uint8_t kind, uint16_t live, uint16_t &recorded, uint16_t replayed) {
+    uint16_t value = replaying ? replayed : live;
+    if (value != recorded && journal_recording()) {
+        journal_record_span(bus_cycle_count, kind, value);
+        recorded = value;
+    }
+    return value;
+}
+
+// Every event the guest takes off the queue goes to the journal (if one is
+// being recorded), stamped with the cycle it was taken at
+static bool pop_key_event(KeyEvent &event) {
+    if (!key_events.pop(event)) return false;
+    if (journal_recording()) {
+        uint8_t flags = (event.pressed ? JOURNAL_PRESSED : 0) | (event.repeat ? JOURNAL_REPEAT : 0);
+        journal_record(bus_cycle_count, event.key, flags);
+    }
+    return true;
+}
+
+// Everything a key has been configured with, 8 bytes so a SHOW_KEY lookup
+// touches a single cache line. Fields are only meaningful when their
+// KEY_HAS_* bit is set.
+enum : uint8_t {
+    KEY_HAS_FREQ  = 1 << 0,
+    KEY_HAS_WAV   = 1 << 1,
+    KEY_HAS_MODE  = 1 << 2,
+    KEY_HAS_COLOR = 1 << 3,
+};
+
+struct KeyProfile {
+    uint16_t frequency;     // Hz
+    uint8_t wav_id;         // Sound bank ID
+    uint8_t audio_mode;     // 0=freq, 1=wav, 2=both
+    uint8_t wave_type;      // Waveform for frequency mode
+    uint8_t color;          // RGB332
+    uint8_t present;        // KEY_HAS_* bits
+    uint8_t reserved;
+};
+static_assert(sizeof(KeyProfile) == 8, "KeyProfile should stay 8 bytes");
+
+// Enhanced piano state
+// Key profiles are owned by the emulation thread, highlight state by the render thread.
+struct EnhancedPianoState {
+    char current_key_for_setup = 0;
+    uint16_t wait_key_timeout_ms = 0;   // 0 = WAIT_KEY waits forever
+    
+    // Audio + visual mappings, indexed by key byte
+    KeyProfile keys[256] = {};
+    
+    // Highlights: which keys are lit, when each goes out (NO_DEADLINE while
+    // held) and the wheel of pending deadlines
+    uint64_t highlighted[4] = {};
+    uint64_t highlight_deadline[256] = {};
+    uint64_t wheel[WHEEL_SLOTS][4] = {};
+    uint64_t wheel_tick = 0;            // Last tick update_piano_state() handled
+    uint64_t clock_ns = 0;              // Piano clock at the last update
+} static piano_state;
+
+static KeyProfile &key_profile(char key) {
+    return piano_state.keys[(unsigned char)key];
+}
+
+static inline int lowest_bit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+void init_enhanced_piano_system(bool headless) {
+    cout << "Initializing Enhanced Dual-Audio Piano System..." << endl;
+    /* Don't need default frequency mappings anymore
+    // Default frequency mappings (piano scale)
+    piano_state.key_to_frequency['q'] = 261;  // C4
+    piano_state.key_to_frequency['w'] = 277;  // C#4  
+    piano_state.key_to_frequency['e'] = 293;  // D4
+    piano_state.key_to_frequency['r'] = 311;  // D#4
+    piano_state.key_to_frequency['t'] = 329;  // E4
+    piano_state.key_to_frequency['y'] = 349;  // F4
+    piano_state.key_to_frequency['u'] = 369;  // F#4
+    piano_state.key_to_frequency['i'] = 391;  // G4
+    piano_state.key_to_frequency['o'] = 415;  // G#4
+    piano_state.key_to_frequency['p'] = 440;  // A4
+    
+    piano_state.key_to_frequency['a'] = 466;  // A#4
+    piano_state.key_to_frequency['s'] = 493;  // B4
+    piano_state.key_to_frequency['d'] = 523;  // C5
+    piano_state.key_to_frequency['f'] = 554;  // C#5
+    piano_state.key_to_frequency['g'] = 587;  // D5
+    piano_state.key_to_frequency['h'] = 622;  // D#5
+    piano_state.key_to_frequency['j'] = 659;  // E5
+    piano_state.key_to_frequency['k'] = 698;  // F5
+    piano_state.key_to_frequency['l'] = 740;  // F#5
+    
+    piano_state.key_to_frequency['z'] = 783;  // G5
+    piano_state.key_to_frequency['x'] = 831;  // G#5
+    piano_state.key_to_frequency['c'] = 880;  // A5  
+    piano_state.key_to_frequency['v'] = 932;  // A#5
+    piano_state.key_to_frequency['b'] = 988;  // B5
+    piano_state.key_to_frequency['n'] = 1047; // C6
+    piano_state.key_to_frequency['m'] = 1109; // C#6
+    
+    // Default audio modes (all start as frequency-based)
+    const char* keys = "qwertyuiopasdfghjklzxcvbnm";
+    for (int i = 0; keys[i]; i++) {
+        piano_state.key_to_audio_mode[keys[i]] = 0;  // 0 = frequency mode
+        piano_state.key_to_wave_type[keys[i]] = 0;   // 0 = sine wave
+    }*/
+    
+    // Initialize systems
+    if (headless) {
+        init_graphics_headless();
+        init_audio_headless();
+    } else {
+        init_graphics();
+        init_audio();
+    }
+    
+    cout << "WAV files available: " << get_sound_count() << endl;
+    if (get_sound_count() > 0) {
+        list_available_sounds();
+    }
+    
+    cout << "Enhanced Piano System Ready!" << endl;
+    cout << "Frequency support: (unlimited frequencies)" << endl;
+    cout << "WAV file support: " << (get_sound_count() > 0 ? "Yup" : "No") 
+         << " (" << get_sound_count() << " files)" << endl;
+    cout << "Color support:  (RGB332 format)" << endl;
+    cout << "Key mapping:  (26 keys available)" << endl;
+}
+
+
+void playLetterSound(char letter) {
+    if ((letter >= 'A' && letter <= 'Z') || (letter >= 'a' && letter <= 'z')) {
+        LOG(LOG_AUDIO, LOG_INFO, "[AutoSound] Playing letter: %c", letter);
+        play_letter_sound(letter);
+    } else {
+        LOG(LOG_AUDIO, LOG_INFO, "[AutoSound] Ignored key: %d", (int)letter);
+    }
+}
+
+
+static void push_audio_command(const PianoCommand &cmd) {
+    if (!audio_commands.push(cmd)) dropped_commands++;
+    platform_event_signal(audio_commands_ready);
+}
+
+
+static void queue_tone(int frequency, int wave_type, float duration) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::PlayTone;
+    cmd.frequency = frequency;
+    cmd.wave_type = wave_type;
+    cmd.duration = duration;
+    push_audio_command(cmd);
+}
+
+static void queue_wav(int wav_id) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::PlayWav;
+    cmd.wav_id = wav_id;
+    push_audio_command(cmd);
+}
+
+static void queue_mixed(int frequency, int wav_id, float duration) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::PlayMixed;
+    cmd.frequency = frequency;
+    cmd.wav_id = wav_id;
+    cmd.duration = duration;
+    push_audio_command(cmd);
+}
+
+static void queue_letter(char key) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::PlayLetter;
+    cmd.key = key;
+    push_audio_command(cmd);
+}
+
+static void queue_note_on(char key, int frequency, int wave_type) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::NoteOn;
+    cmd.key = key;
+    cmd.frequency = frequency;
+    cmd.wave_type = wave_type;
+    push_audio_command(cmd);
+}
+
+static void queue_note_off(char key) {
+    PianoCommand cmd = {};
+    cmd.type = PianoCommandType::NoteOff;
+    cmd.key = key;
+    push_audio_command(cmd);
+}
+
+static void publish_key_visual(char key, uint64_t visual) {
+    key_visuals.begin_write();
+    key_visuals.set((unsigned char)key, visual);
+    key_visuals.end_write();
+}
+
+static void publish_show(char key, bool held, int r, int g, int b) {
+    uint64_t shows = (key_visuals.get((unsigned char)key) >> 32) + 1;
+    uint8_t flags = held ? KEY_VISUAL_NOTE | KEY_VISUAL_HELD : 0;
+    publish_key_visual(key, shows << 32 | (uint64_t)(r & 0xFF) << 24 | (uint64_t)(g & 0xFF) << 16 |
+                            (uint64_t)(b & 0xFF) << 8 | flags);
+}
+
+static void publish_release(char key) {
+    uint64_t visual = key_visuals.get((unsigned char)key);
+    if (visual & KEY_VISUAL_HELD) publish_key_visual(key, visual & ~(uint64_t)KEY_VISUAL_HELD);
+}
+
+static uint64_t *wheel_slot(uint64_t deadline) {
+    return piano_state.wheel[(deadline >> WHEEL_TICK_SHIFT) & (WHEEL_SLOTS - 1)];
+}
+
+// (Re)arm a key's highlight; NO_DEADLINE takes it off the wheel
+static void set_highlight_deadline(unsigned char index, uint64_t deadline) {
+    uint64_t bit = 1ull << (index & 63);
+    uint64_t &current = piano_state.highlight_deadline[index];
+    if (current != NO_DEADLINE) wheel_slot(current)[index >> 6] &= ~bit;
+    current = deadline;
+    if (deadline != NO_DEADLINE) wheel_slot(deadline)[index >> 6] |= bit;
+}
+
+static void start_highlight(char key, int highlight_ms) {
+    unsigned char index = (unsigned char)key;
+    bool lit = (piano_state.highlighted[index >> 6] >> (index & 63)) & 1;
+    if (!lit) piano_state.highlight_deadline[index] = NO_DEADLINE;
+    set_highlight_deadline(index, highlight_ms == HIGHLIGHT_HELD ? NO_DEADLINE
+                                  : piano_state.clock_ns + highlight_ms * 1000000ull);
+    piano_state.highlighted[index >> 6] |= 1ull << (index & 63);
+}
+
+static void release_highlight(char key) {
+    unsigned char index = (unsigned char)key;
+    bool lit = (piano_state.highlighted[index >> 6] >> (index & 63)) & 1;
+    if (lit && piano_state.highlight_deadline[index] == NO_DEADLINE) {
+        set_highlight_deadline(index, piano_state.clock_ns + HIGHLIGHT_RELEASE_MS * 1000000ull);
+    }
+}
+
+void check_keyboard_input() {
+    KeyInputEvent inputs[64];
+    int count = poll_key_events(inputs, 64);
+    uint64_t now = platform_time_ns();
+    
+    for (int i = 0; i < count; i++) {
+        char key = inputs[i].key;
+        KeyEvent event = {key, inputs[i].pressed, inputs[i].repeat, now};
+        if (!key_events.push(event)) {
+            uint16_t lost = key_overflow.load(std::memory_order_relaxed);
+            if (lost < 0xFFFF) key_overflow.store(lost + 1, std::memory_order_relaxed);
+        }
+        
+        if (!inputs[i].pressed) {
+            // Lit for as long as the key is down
+            release_highlight(key);
+            LOG(LOG_KEYS, LOG_INFO, "Key '%c' released", key);
+            continue;
+        }
+        if (inputs[i].repeat) continue;
+        
+        // Visual feedback
+        start_highlight(key, HIGHLIGHT_HELD);
+        set_key_pressed(key, true);
+        set_key_color(key, 255, 255, 255);
+        
+        LOG(LOG_KEYS, LOG_INFO, "Key '%c' pressed (ASCII %d)", key, (int)key);
+
+        // FOR ALPHABET KEYBOARD
+        
+        //playLetterSound(key);
+    }
+    
+    // Unpark the emulation thread if the guest is waiting on the keyboard
+    if (count > 0) bus_wake();
+}
+
+// Render thread: the last key_visuals snapshot applied
+static uint32_t applied_visuals_version = 0;
+static uint64_t applied_visuals[256] = {};
+
+void apply_key_visuals() {
+    if (key_visuals.version() == applied_visuals_version) return;
+    
+    uint64_t visuals[256];
+    applied_visuals_version = key_visuals.read(visuals);
+    for (int i = 0; i < 256; i++) {
+        uint64_t visual = visuals[i];
+        uint64_t old = applied_visuals[i];
+        if (visual == old) continue;
+        applied_visuals[i] = visual;
+        
+        char key = (char)i;
+        if ((visual >> 32) != (old >> 32)) {
+            bool note = (visual & KEY_VISUAL_NOTE) != 0;
+            start_highlight(key, note ? HIGHLIGHT_HELD : HIGHLIGHT_SHOW_MS);
+            set_key_pressed(key, true);
+            set_key_color(key, (visual >> 24) & 0xFF, (visual >> 16) & 0xFF, (visual >> 8) & 0xFF);
+            // NOTE_ON and NOTE_OFF in the same frame still light the key briefly
+            if (note && !(visual & KEY_VISUAL_HELD)) release_highlight(key);
+        } else if ((old & KEY_VISUAL_HELD) && !(visual & KEY_VISUAL_HELD)) {
+            release_highlight(key);
+        }
+    }
+}
+
+// Audio thread: these calls only block in the Beep() fallback, which is fine here
+static void run_audio_command(const PianoCommand &cmd) {
+    switch (cmd.type) {
+        case PianoCommandType::PlayTone:
+            play_tone_with_type(cmd.frequency, cmd.wave_type, cmd.duration);
+            break;
+        case PianoCommandType::PlayWav:
+            play_wav_file_by_id(cmd.wav_id);
+            break;
+        case PianoCommandType::PlayMixed:
+            play_sound_mixed(cmd.frequency, cmd.wav_id, cmd.duration);
+            break;
+        case PianoCommandType::PlayLetter:
+            playLetterSound(cmd.key);
+            break;
+        case PianoCommandType::NoteOn:
+            note_on((unsigned char)cmd.key, cmd.frequency, cmd.wave_type);
+            break;
+        case PianoCommandType::NoteOff:
+            note_off((unsigned char)cmd.key);
+            break;
+        default:
+            break;
+    }
+}
+
+void piano_replay_key(char key, bool pressed, bool repeat) {
+    KeyEvent event = {key, pressed, repeat, platform_time_ns()};
+    key_events.push(event);
+}
+
+void piano_replay_begin() {
+    replaying = true;
+    replay_view = QueueView();
+}
+
+void piano_replay_queue_state(uint8_t kind, uint16_t value) {
+    if (kind == JOURNAL_DEPTH) replay_view.depth = value;
+    if (kind == JOURNAL_OVERFLOW) replay_view.overflow = value;
+}
+
+bool run_pending_audio_commands() {
+    PianoCommand cmd;
+    bool ran = false;
+    while (audio_commands.pop(cmd)) {
+        run_audio_command(cmd);
+        ran = true;
+    }
+    return ran;
+}
+
+void wait_audio_commands(uint64_t timeout_ns) {
+    platform_event_wait_ns(audio_commands_ready, timeout_ns);
+}
+
+void wake_audio_commands() {
+    platform_event_signal(audio_commands_ready);
+}
+
+uint32_t piano_dropped_commands() {
+    return dropped_commands.load();
+}
+
+void update_piano_state(uint64_t now_ns) {
+    piano_state.clock_ns = now_ns;
+    
+    // Visit the wheel slots from the last tick up to now (each slot once at
+    // most) and put out the keys whose deadline has passed
+    uint64_t tick = now_ns >> WHEEL_TICK_SHIFT;
+    uint64_t first = piano_state.wheel_tick;
+    if (tick - first >= WHEEL_SLOTS) first = tick - (WHEEL_SLOTS - 1);
+    for (uint64_t t = first; t <= tick; t++) {
+        uint64_t *slot = piano_state.wheel[t & (WHEEL_SLOTS - 1)];
+        for (int w = 0; w < 4; w++) {
+            uint64_t due = slot[w];
+            while (due) {
+                int index = w * 64 + lowest_bit(due);
+                due &= due - 1;
+                
+                if (piano_state.highlight_deadline[index] > now_ns) continue;    // A later turn
+                slot[w] &= ~(1ull << (index & 63));
+                piano_state.highlight_deadline[index] = NO_DEADLINE;
+                piano_state.highlighted[w] &= ~(1ull << (index & 63));
+                set_key_pressed((char)index, false);
+            }
+        }
+    }
+    piano_state.wheel_tick = tick;
+}
+
+// SHOW_KEY / NOTE_ON: light the key and play its mapped sound.
+// A held key stays lit and its tone sustains until NOTE_OFF.
+static void show_key(char key, bool held) {
+    LOG(LOG_BUS, LOG_INFO, "%s: '%c'", held ? "NOTE_ON" : "SHOW_KEY", key);
+    
+    const KeyProfile &profile = key_profile(key);
+    
+    // Apply custom color if set
+    int r = 255, g = 255, b = 255;
+    const char* color_name = "White";
+    
+    if (profile.present & KEY_HAS_COLOR) {
+        r = ((profile.color >> 5) & 0x07) * 36;  // Extract red (3 bits)
+        g = ((profile.color >> 2) & 0x07) * 36;  // Extract green (3 bits)  
+        b = (profile.color & 0x03) * 85;         // Extract blue (2 bits)
+        color_name = "Custom";
+    }
+    
+    // Visual feedback
+    publish_show(key, held, r, g, b);
+    LOG(LOG_BUS, LOG_INFO, "Color: %s RGB(%d,%d,%d)", color_name, r, g, b);
+    
+    // Play sound based on key's audio mode
+    int audio_mode = (profile.present & KEY_HAS_MODE) ? profile.audio_mode : 0; // Default to frequency
+    bool has_freq = (profile.present & KEY_HAS_FREQ) != 0;
+    bool has_wav = (profile.present & KEY_HAS_WAV) != 0;
+    
+    switch(audio_mode) {
+        case 0: // Frequency mode
+            if (has_freq) {
+                LOG(LOG_BUS, LOG_INFO, "Playing frequency: %dHz (wave_type=%d)", profile.frequency, profile.wave_type);
+                if (held) {
+                    queue_note_on(key, profile.frequency, profile.wave_type);
+                } else {
+                    queue_tone(profile.frequency, profile.wave_type, 0.3f);
+                }
+            }
+            break;
+            
+        case 1: // WAV mode
+            if (has_wav) {
+                LOG(LOG_BUS, LOG_INFO, "Playing WAV: %s", get_sound_name_by_id(profile.wav_id));
+                queue_wav(profile.wav_id);
+            }
+            break;
+            
+        case 2: // Both frequency + WAV
+            if (has_freq && has_wav) {
+                LOG(LOG_BUS, LOG_INFO, "Playing BOTH: %dHz + %s", profile.frequency, get_sound_name_by_id(profile.wav_id));
+                if (held) {
+                    queue_note_on(key, profile.frequency, profile.wave_type);
+                    queue_wav(profile.wav_id);
+                } else {
+                    queue_mixed(profile.frequency, profile.wav_id, 0.3f);
+                }
+            }
+            break;
+    }
+}
+
+// ---- Port handlers ----
+// Reads start with data = 0 and delay = 0 (see bus.c)
+
+static void get_key_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    // Oldest queued key press, 0 when the queue is empty
+    KeyEvent event;
+    while (pop_key_event(event)) {
+        if (!event.pressed) continue;
+        data->u = (tny_uword)event.key;
+        LOG(LOG_BUS, LOG_INFO, "Assembly read key: '%c' (queued %lluus)", event.key,
+            (unsigned long long)((platform_time_ns() - event.timestamp_ns) / 1000));
+        break;
+    }
+}
+
+static int key_queue_ready() {
+    return !key_events.empty();
+}
+
+static void wait_key_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    // GET_KEY that doesn't come back empty: the host waits for the next press
+    // (or WAIT_KEY_TIMEOUT) and the guest sees the wait as a bus stall.
+    // 0 only on timeout or shutdown. The timeout covers the whole read, in
+    // guest time, so releases that wake the wait don't restart it.
+    const uint64_t budget = bus_ms_to_cycles(piano_state.wait_key_timeout_ms);
+    uint64_t waited = 0;
+    KeyEvent event;
+    for (;;) {
+        bool found = false;
+        while (pop_key_event(event)) {
+            if (!event.pressed) continue;
+            data->u = (tny_uword)event.key;
+            found = true;
+            break;
+        }
+        if (found) break;
+        
+        if (budget && waited >= budget) break;
+        uint64_t span = bus_wait(budget ? budget - waited : 0, key_queue_ready);
+        if (span && journal_recording()) journal_record_span(bus_cycle_count, JOURNAL_WAIT, span);
+        waited += span;
+        if (!key_queue_ready()) break;      // Timed out or stopping
+    }
+    
+    *delay = waited > 0xFFFF ? 0xFFFF : (uint16_t)waited;
+    bus_cycle_count += waited - *delay;
+    LOG(LOG_BUS, LOG_DEBUG, "WAIT_KEY: '%c' after %llu cycles", data->u ? (char)data->u : '-',
+        (unsigned long long)waited);
+}
+
+static void wait_key_timeout_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    piano_state.wait_key_timeout_ms = data.u;
+}
+
+static void get_key_event_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    // Oldest press/release, auto-repeats are only for GET_KEY
+    KeyEvent event;
+    while (pop_key_event(event)) {
+        if (event.repeat) continue;
+        data->u = (tny_uword)(unsigned char)event.key;
+        if (!event.pressed) data->u |= KEY_EVENT_RELEASED;
+        break;
+    }
+}
+
+static void get_key_depth_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    data->u = observe_queue(JOURNAL_DEPTH, (uint16_t)key_events.size(), recorded_view.depth, replay_view.depth);
+}
+
+static void get_key_overflow_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    data->u = observe_queue(JOURNAL_OVERFLOW, key_overflow.load(std::memory_order_relaxed),
+                            recorded_view.overflow, replay_view.overflow);
+}
+
+static void get_wav_count_read(teenyat *t, tny_uword addr, tny_word *data, uint16_t *delay, void *context) {
+    data->u = get_sound_count();
+    LOG(LOG_BUS, LOG_INFO, "Assembly read WAV count: %u", (unsigned)data->u);
+}
+
+static void play_frequency_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    // Format: [wave_type:4][duration:4][frequency:8]
+    int frequency_code = data.u & 0xFF;           // Bottom 8 bits
+    int duration_code = (data.u >> 8) & 0xF;      // Next 4 bits  
+    int wave_type = (data.u >> 12) & 0xF;         // Top 4 bits
+    
+    // Map frequency code to actual frequency
+    int actual_freq = 220 + (frequency_code * 10); // 220Hz to 2770Hz range
+    float duration = 0.1f + (duration_code * 0.1f); // 0.1s to 1.6s
+    
+    LOG(LOG_BUS, LOG_INFO, "PLAY_FREQUENCY: %dHz, %gs, wave_type=%d", actual_freq, duration, wave_type);
+    
+    queue_tone(actual_freq, wave_type, duration);
+}
+
+static void play_wav_id_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    int wav_id = data.u;
+    if (wav_id < get_sound_count()) {
+        LOG(LOG_BUS, LOG_INFO, "PLAY_WAV_ID: %d (%s)", wav_id, get_sound_name_by_id(wav_id));
+        queue_wav(wav_id);
+    } else {
+        LOG(LOG_BUS, LOG_WARN, "PLAY_WAV_ID: %d (INVALID - max %d)", wav_id, get_sound_count()-1);
+        queue_tone(440, 0, 0.3f); // Error beep
+    }
+}
+
+static void play_letter_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    char key = (char)data.u;
+    LOG(LOG_BUS, LOG_INFO, "PLAY_LETTER: '%c'", key);
+    if (key!=0) {
+        queue_letter(key);
+    }
+}
+
+static void show_key_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    show_key((char)data.u, false);
+}
+
+static void note_on_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    show_key((char)data.u, true);
+}
+
+static void note_off_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    char key = (char)data.u;
+    LOG(LOG_BUS, LOG_INFO, "NOTE_OFF: '%c'", key);
+    queue_note_off(key);
+    publish_release(key);
+}
+
+static void set_key_freq_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    // First call selects key, second call sets frequency
+    if (piano_state.current_key_for_setup == 0) {
+        piano_state.current_key_for_setup = (char)data.u;
+        LOG(LOG_BUS, LOG_INFO, "Selected key '%c' for configuration", piano_state.current_key_for_setup);
+    } else {
+        KeyProfile &profile = key_profile(piano_state.current_key_for_setup);
+        profile.frequency = data.u;
+        profile.present |= KEY_HAS_FREQ;
+        LOG(LOG_BUS, LOG_INFO, "Set key '%c' frequency to %uHz", piano_state.current_key_for_setup, (unsigned)data.u);
+        piano_state.current_key_for_setup = 0; // Reset selection
+    }
+}
+
+static void set_key_wav_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    if (piano_state.current_key_for_setup != 0) {
+        if (data.u < get_sound_count()) {
+            KeyProfile &profile = key_profile(piano_state.current_key_for_setup);
+            profile.wav_id = (uint8_t)data.u;
+            profile.present |= KEY_HAS_WAV;
+            LOG(LOG_BUS, LOG_INFO, "Set key '%c' WAV to %u (%s)", piano_state.current_key_for_setup,
+                (unsigned)data.u, get_sound_name_by_id(data.u));
+        } else {
+            LOG(LOG_BUS, LOG_WARN, "Invalid WAV ID %u for key '%c'", (unsigned)data.u, piano_state.current_key_for_setup);
+        }
+        piano_state.current_key_for_setup = 0; // Reset selection
+    } else {
+        LOG(LOG_BUS, LOG_WARN, "No key selected for WAV mapping");
+    }
+}
+
+static void set_key_color_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    if (piano_state.current_key_for_setup != 0) {
+        KeyProfile &profile = key_profile(piano_state.current_key_for_setup);
+        profile.color = data.u & 0xFF;
+        profile.present |= KEY_HAS_COLOR;
+        
+        int r = ((data.u >> 5) & 0x07) * 36;
+        int g = ((data.u >> 2) & 0x07) * 36;  
+        int b = (data.u & 0x03) * 85;
+        
+        LOG(LOG_BUS, LOG_INFO, "Set key '%c' color to RGB(%d,%d,%d) [0x%x]", piano_state.current_key_for_setup,
+            r, g, b, (unsigned)(data.u & 0xFF));
+        piano_state.current_key_for_setup = 0; // Reset selection
+    } else {
+        LOG(LOG_BUS, LOG_WARN, "No key selected for color mapping");
+    }
+}
+
+static void set_key_mode_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    // Format: [key:8][mode:4][wave_type:4]
+    char key = (char)(data.u & 0xFF);
+    int mode = (data.u >> 8) & 0xF;
+    int wave_type = (data.u >> 12) & 0xF;
+    
+    piano_state.current_key_for_setup = key; // Auto-select key
+    KeyProfile &profile = key_profile(key);
+    profile.audio_mode = (uint8_t)mode;
+    profile.wave_type = (uint8_t)wave_type;
+    profile.present |= KEY_HAS_MODE;
+    
+    const char* mode_names[] = {"Frequency", "WAV", "Both", "Reserved"};
+    LOG(LOG_BUS, LOG_INFO, "Set key '%c' mode to %s (wave_type=%d)", key, mode_names[mode % 4], wave_type);
+}
+
+static void play_combined_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    // Format: [wav_id:8][frequency_code:8]
+    int frequency_code = data.u & 0xFF;
+    int wav_id = (data.u >> 8) & 0xFF;
+    int actual_freq = 220 + (frequency_code * 10);
+    
+    LOG(LOG_BUS, LOG_INFO, "PLAY_COMBINED: %dHz + WAV %d", actual_freq, wav_id);
+    queue_mixed(actual_freq, wav_id, 0.5f);
+}
+
+static void list_wavs_write(teenyat *t, tny_uword addr, tny_word data, uint16_t *delay, void *context) {
+    cout << "=== Assembly requested WAV list ===" << endl;
+    list_available_sounds();
+    cout << "=== End of WAV list ===" << endl;
+}
+
+// Enhanced I/O Port addresses
+struct PianoPort {
+    tny_uword addr;
+    const char *name;
+    const char *description;
+    bus_read_handler read;
+    bus_write_handler write;
+};
+
+static const PianoPort piano_ports[] = {
+    {0x9000, "GET_KEY",          "read keyboard input",                          get_key_read,          nullptr},
+    {0x9001, "PLAY_FREQUENCY",   "play frequency/beep with wave type",           nullptr,               play_frequency_write},
+    {0x9002, "PLAY_WAV_ID",      "play WAV file by ID",                          nullptr,               play_wav_id_write},
+    {0x9003, "SHOW_KEY",         "visual + audio feedback",                      nullptr,               show_key_write},
+    {0x9004, "SET_KEY_FREQ",     "map key to frequency",                         nullptr,               set_key_freq_write},
+    {0x9005, "SET_KEY_WAV",      "map key to WAV file",                          nullptr,               set_key_wav_write},
+    {0x9006, "SET_KEY_COLOR",    "set key color RGB332",                         nullptr,               set_key_color_write},
+    {0x9007, "GET_WAV_COUNT",    "read number of WAV files",                     get_wav_count_read,    nullptr},
+    {0x9008, "LIST_WAVS",        "display available WAV files",                  nullptr,               list_wavs_write},
+    {0x9009, "PLAY_COMBINED",    "play frequency + WAV together",                nullptr,               play_combined_write},
+    {0x900A, "SET_KEY_MODE",     "set key audio mode",                           nullptr,               set_key_mode_write},
+    {0x900B, "PLAY_LETTER",      "play alphabet sound for a letter",             nullptr,               play_letter_write},
+    {0x900C, "GET_KEY_DEPTH",    "read number of queued key events",             get_key_depth_read,    nullptr},
+    {0x900D, "GET_KEY_OVERFLOW", "read count of key events lost to a full queue", get_key_overflow_read, nullptr},
+    {0x900E, "GET_KEY_EVENT",    "read next key event, bit 15 set = released",   get_key_event_read,    nullptr},
+    {0x900F, "NOTE_ON",          "start a held note for a key",                  nullptr,               note_on_write},
+    {0x9010, "NOTE_OFF",         "release a held note",                          nullptr,               note_off_write},
+    {0x9011, "WAIT_KEY",         "read next key press, waiting for one",         wait_key_read,         nullptr},
+    {0x9012, "WAIT_KEY_TIMEOUT", "WAIT_KEY timeout in ms, 0 = wait forever",     nullptr,               wait_key_timeout_write},
+};
+
+void piano_register_ports() {
+    // Created at startup, before the emulation thread can push a command
+    if (!audio_commands_ready) audio_commands_ready = platform_event_create();
+    for (const PianoPort &port : piano_ports) {
+        bus_register(port.addr, 1, port.name, port.description, port.read, port.write, nullptr);
+    }
+    // An empty key read is how every guest waits for the player
+    bus_mark_idle_poll(0x9000);     // GET_KEY
+    bus_mark_idle_poll(0x900E);     // GET_KEY_EVENT
+}
@@ -0,0 +1,43 @@
+#ifndef PIANO_H
+#define PIANO_H
+
+#include <cstdint>
+
+// The piano peripheral: keyboard, key mappings, sounds and highlights.
+// Its I/O ports (0x9000 - 0x9012) are registered on the bus by
+// piano_register_ports(); bus handlers run on the emulation thread and only
+// queue work for the audio thread or publish key looks for the render thread.
+
+// headless: no window (keys come from inject_key) and silent audio
+void init_enhanced_piano_system(bool headless = false);
+void piano_register_ports();
+
+// Render thread, once per frame. update_piano_state() goes first: it sets the
+// piano clock (monotonic ns; virtual time when headless) that highlights are
+// timed against, then expires the ones that are due. apply_key_visuals()
+// picks up what the guest has shown since the last frame.
+void update_piano_state(uint64_t now_ns);
+void check_keyboard_input();
+void apply_key_visuals();
+
+// Journal replay: queue a key event for the guest directly, skipping the
+// keyboard snapshot (call on the emulation thread, between cycles)
+void piano_replay_key(char key, bool pressed, bool repeat);
+
+// From here on GET_KEY_DEPTH and GET_KEY_OVERFLOW return what the recording
+// saw (JOURNAL_DEPTH/JOURNAL_OVERFLOW records) instead of the live queue
+void piano_replay_begin();
+void piano_replay_queue_state(uint8_t kind, uint16_t value);
+
+// Audio thread; returns false when there was nothing queued
+bool run_pending_audio_commands();
+
+// Audio thread: sleep until a command is queued, wake_audio_commands() is
+// called (e.g. at shutdown) or timeout_ns passes
+void wait_audio_commands(uint64_t timeout_ns);
+void wake_audio_commands();
+
+// Commands lost because a queue was full
+uint32_t piano_dropped_commands();
+
+#endif // PIANO_H
@@ -0,0 +1,224 @@
+#include "platform.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct platform_thread {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    platform_thread_fn fn;
+    void *arg;
+};
+
+struct platform_event {
+#ifdef _WIN32
+    SRWLOCK lock;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+    int signalled;
+};
+
+#ifdef _WIN32
+static LARGE_INTEGER qpc_frequency;
+static int timer_resolution_set = 0;
+#endif
+
+uint64_t platform_time_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    if (qpc_frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&qpc_frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    // Split to avoid overflowing 64 bits on long uptimes
+    uint64_t seconds = counter.QuadPart / qpc_frequency.QuadPart;
+    uint64_t remainder = counter.QuadPart % qpc_frequency.QuadPart;
+    return seconds * 1000000000ull + remainder * 1000000000ull / qpc_frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void platform_sleep_ns(uint64_t ns) {
+    if (ns == 0) return;
+#ifdef _WIN32
+    // Default scheduler tick is ~15.6ms, far too coarse for frame pacing
+    if (!timer_resolution_set) {
+        timeBeginPeriod(1);
+        timer_resolution_set = 1;
+    }
+    DWORD ms = (DWORD)(ns / 1000000ull);
+    Sleep(ms > 0 ? ms : 1);
+#else
+    struct timespec req, rem;
+    req.tv_sec = (time_t)(ns / 1000000000ull);
+    req.tv_nsec = (long)(ns % 1000000000ull);
+    while (nanosleep(&req, &rem) == -1 && errno == EINTR) {
+        req = rem;
+    }
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI platform_thread_entry(LPVOID param) {
+    platform_thread *thread = (platform_thread *)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+#else
+static void *platform_thread_entry(void *param) {
+    platform_thread *thread = (platform_thread *)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+#endif
+
+platform_thread *platform_thread_start(platform_thread_fn fn, void *arg) {
+    platform_thread *thread = (platform_thread *)malloc(sizeof(platform_thread));
+    if (!thread) return NULL;
+    thread->fn = fn;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, platform_thread_entry, thread, 0, NULL);
+    if (!thread->handle) {
+        free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, platform_thread_entry, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void platform_thread_join(platform_thread *thread) {
+    if (!thread) return;
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+platform_event *platform_event_create(void) {
+    platform_event *event = (platform_event *)malloc(sizeof(platform_event));
+    if (!event) return NULL;
+    event->signalled = 0;
+#ifdef _WIN32
+    InitializeSRWLock(&event->lock);
+    InitializeConditionVariable(&event->cond);
+#else
+    pthread_mutex_init(&event->lock, NULL);
+#ifdef __APPLE__
+    // No pthread_condattr_setclock(); waits use relative timeouts instead
+    pthread_cond_init(&event->cond, NULL);
+#else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&event->cond, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
+#endif
+    return event;
+}
+
+void platform_event_destroy(platform_event *event) {
+    if (!event) return;
+#ifndef _WIN32
+    pthread_cond_destroy(&event->cond);
+    pthread_mutex_destroy(&event->lock);
+#endif
+    free(event);
+}
+
+void platform_event_signal(platform_event *event) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&event->lock);
+    event->signalled = 1;
+    ReleaseSRWLockExclusive(&event->lock);
+    WakeConditionVariable(&event->cond);
+#else
+    pthread_mutex_lock(&event->lock);
+    event->signalled = 1;
+    pthread_mutex_unlock(&event->lock);
+    pthread_cond_signal(&event->cond);
+#endif
+}
+
+int platform_event_wait_ns(platform_event *event, uint64_t timeout_ns) {
+#ifdef _WIN32
+    uint64_t deadline = platform_time_ns() + timeout_ns;
+    AcquireSRWLockExclusive(&event->lock);
+    while (!event->signalled) {
+        uint64_t now = platform_time_ns();
+        if (now >= deadline) break;
+        DWORD ms = (DWORD)((deadline - now + 999999) / 1000000);
+        SleepConditionVariableSRW(&event->cond, &event->lock, ms, 0);
+    }
+    int signalled = event->signalled;
+    event->signalled = 0;
+    ReleaseSRWLockExclusive(&event->lock);
+    return signalled;
+#elif defined(__APPLE__)
+    uint64_t deadline_ns = platform_time_ns() + timeout_ns;
+    pthread_mutex_lock(&event->lock);
+    while (!event->signalled) {
+        uint64_t now = platform_time_ns();
+        if (now >= deadline_ns) break;
+        struct timespec remaining;
+        remaining.tv_sec = (time_t)((deadline_ns - now) / 1000000000ull);
+        remaining.tv_nsec = (long)((deadline_ns - now) % 1000000000ull);
+        pthread_cond_timedwait_relative_np(&event->cond, &event->lock, &remaining);
+    }
+    int signalled = event->signalled;
+    event->signalled = 0;
+    pthread_mutex_unlock(&event->lock);
+    return signalled;
+#else
+    uint64_t deadline_ns = platform_time_ns() + timeout_ns;
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    deadline.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    
+    pthread_mutex_lock(&event->lock);
+    while (!event->signalled) {
+        if (pthread_cond_timedwait(&event->cond, &event->lock, &deadline) == ETIMEDOUT) break;
+    }
+    int signalled = event->signalled;
+    event->signalled = 0;
+    pthread_mutex_unlock(&event->lock);
+    return signalled;
+#endif
+}
+
+int platform_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
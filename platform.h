@@ -0,0 +1,40 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Monotonic host clock
+uint64_t platform_time_ns(void);
+
+// Sleep the calling thread (granularity is whatever the OS gives us)
+void platform_sleep_ns(uint64_t ns);
+
+// Minimal thread wrapper for the C modules (main.cpp uses std::thread)
+typedef struct platform_thread platform_thread;
+typedef void (*platform_thread_fn)(void *arg);
+
+platform_thread *platform_thread_start(platform_thread_fn fn, void *arg);
+void platform_thread_join(platform_thread *thread);
+
+// Auto-reset event: a mutex + condition variable with a sticky flag, so a
+// signal sent before the wait starts isn't lost
+typedef struct platform_event platform_event;
+
+platform_event *platform_event_create(void);
+void platform_event_destroy(platform_event *event);
+void platform_event_signal(platform_event *event);
+// Returns 1 if signalled, 0 on timeout; clears the flag either way
+int platform_event_wait_ns(platform_event *event, uint64_t timeout_ns);
+
+// Number of logical CPUs, at least 1
+int platform_cpu_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PLATFORM_H
@@ -0,0 +1,155 @@
+#include "script.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+typedef struct {
+    ScriptEvent event;
+    int line;               // Tie-break so same-time events keep file order
+} ScriptEntry;
+
+struct InputScript {
+    ScriptEntry *entries;
+    int count;
+    int next;
+    uint64_t end_cycle;
+};
+
+static int compare_entries(const void *a, const void *b) {
+    const ScriptEntry *x = (const ScriptEntry *)a;
+    const ScriptEntry *y = (const ScriptEntry *)b;
+    if (x->event.cycle != y->event.cycle) return x->event.cycle < y->event.cycle ? -1 : 1;
+    return x->line - y->line;
+}
+
+// "250ms", "1.5s" or a bare cycle count
+static int parse_time(const char *text, double guest_mhz, uint64_t *cycle) {
+    char *end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0) return 0;
+    
+    if (strcmp(end, "ms") == 0) {
+        *cycle = (uint64_t)(value * guest_mhz * 1000.0 + 0.5);
+    } else if (strcmp(end, "s") == 0) {
+        *cycle = (uint64_t)(value * guest_mhz * 1000000.0 + 0.5);
+    } else if (*end == 0 && strchr(text, '.') == NULL) {
+        *cycle = strtoull(text, NULL, 10);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_line(char *line, double guest_mhz, ScriptEvent *event) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    
+    char *time = strtok(line, " \t\r\n");
+    if (!time) return -1;       // Blank or comment
+    char *key = strtok(NULL, " \t\r\n");
+    char *action = strtok(NULL, " \t\r\n");
+    
+    if (!parse_time(time, guest_mhz, &event->cycle) || !key) return 0;
+    
+    if (strcmp(key, "end") == 0 && !action) {
+        event->key = 0;
+        event->pressed = 0;
+        return 1;
+    }
+    if (strlen(key) != 1 || !isalnum((unsigned char)key[0]) || !action || strtok(NULL, " \t\r\n")) return 0;
+    
+    event->key = (char)tolower((unsigned char)key[0]);
+    if (strcmp(action, "down") == 0 || strcmp(action, "press") == 0) {
+        event->pressed = 1;
+    } else if (strcmp(action, "up") == 0 || strcmp(action, "release") == 0) {
+        event->pressed = 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+InputScript *input_script_load(const char *path, double guest_mhz) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Error: Could not open script %s\n", path);
+        return NULL;
+    }
+    
+    InputScript *script = (InputScript *)calloc(1, sizeof(InputScript));
+    if (!script) {
+        printf("Error: Out of memory loading script %s\n", path);
+        fclose(file);
+        return NULL;
+    }
+    int capacity = 0;
+    char line[256];
+    int line_number = 0;
+    
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char original[256];
+        snprintf(original, sizeof(original), "%s", line);
+        
+        ScriptEvent event;
+        int parsed = parse_line(line, guest_mhz, &event);
+        if (parsed < 0) continue;
+        if (parsed == 0) {
+            printf("Error: %s:%d: can't parse \"%s\"\n", path, line_number, strtok(original, "\r\n"));
+            fclose(file);
+            input_script_free(script);
+            return NULL;
+        }
+        
+        if (event.cycle > script->end_cycle) script->end_cycle = event.cycle;
+        if (event.key == 0) continue;   // "end" only moves the end
+        
+        if (script->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            ScriptEntry *entries = (ScriptEntry *)realloc(script->entries, capacity * sizeof(ScriptEntry));
+            if (!entries) {
+                printf("Error: Out of memory loading script %s\n", path);
+                fclose(file);
+                input_script_free(script);
+                return NULL;
+            }
+            script->entries = entries;
+        }
+        script->entries[script->count].event = event;
+        script->entries[script->count].line = line_number;
+        script->count++;
+    }
+    fclose(file);
+    
+    qsort(script->entries, script->count, sizeof(ScriptEntry), compare_entries);
+    printf("Script %s: %d key events, ends at cycle %llu\n", path, script->count,
+           (unsigned long long)script->end_cycle);
+    return script;
+}
+
+void input_script_free(InputScript *script) {
+    if (!script) return;
+    free(script->entries);
+    free(script);
+}
+
+int input_script_next(InputScript *script, uint64_t cycle, ScriptEvent *event) {
+    if (script->next >= script->count) return 0;
+    if (script->entries[script->next].event.cycle > cycle) return 0;
+    *event = script->entries[script->next++].event;
+    return 1;
+}
+
+uint64_t input_script_next_cycle(const InputScript *script) {
+    if (script->next >= script->count) return UINT64_MAX;
+    return script->entries[script->next].event.cycle;
+}
+
+uint64_t input_script_end_cycle(const InputScript *script) {
+    return script->end_cycle;
+}
+
+int input_script_done(const InputScript *script) {
+    return script->next >= script->count;
+}
@@ -0,0 +1,47 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scripted keyboard input for headless runs. One event per line:
+//
+//   # comment
+//   250ms  q down        times in ms, converted to guest cycles at load
+//   400ms  q up
+//   90000  a press       a bare number is a guest cycle count
+//   2s     end           optional: keep running until this time
+//
+// Actions are down/press and up/release. Events are sorted by time, lines
+// with the same time keep their order.
+
+typedef struct {
+    uint64_t cycle;
+    char key;           // Lowercase, 0 for "end"
+    int pressed;
+} ScriptEvent;
+
+typedef struct InputScript InputScript;
+
+// NULL (after printing the offending line) if the file can't be read or parsed
+InputScript *input_script_load(const char *path, double guest_mhz);
+void input_script_free(InputScript *script);
+
+// Next event due at or before cycle; returns 0 when none is due yet
+int input_script_next(InputScript *script, uint64_t cycle, ScriptEvent *event);
+
+// Cycle of the next event, UINT64_MAX once all have been taken
+uint64_t input_script_next_cycle(const InputScript *script);
+
+// Cycle the script runs out at (last event or "end" line)
+uint64_t input_script_end_cycle(const InputScript *script);
+int input_script_done(const InputScript *script);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCRIPT_H
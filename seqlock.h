@@ -0,0 +1,60 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single-writer sequence lock over a fixed array of 64-bit words.
+// The writer never waits: it bumps the sequence to odd, stores, and bumps it
+// back to even. A reader copies the words and retries if the sequence moved
+// underneath it, so it always ends up with a snapshot of one moment.
+// The words are atomics (relaxed) so the racing copy is well defined.
+template <size_t Words>
+class SeqlockArray {
+public:
+    // ---- Writer (one thread) ----
+    void begin_write() {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void set(size_t index, uint64_t value) {
+        words_[index].store(value, std::memory_order_relaxed);
+    }
+
+    // The writer's own view, no locking needed
+    uint64_t get(size_t index) const {
+        return words_[index].load(std::memory_order_relaxed);
+    }
+
+    void end_write() {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // ---- Readers ----
+    // Changes on every write; compare against the value read() returned to
+    // skip the copy when nothing was published since
+    uint32_t version() const {
+        return seq_.load(std::memory_order_acquire);
+    }
+
+    // Copy a consistent snapshot into out[Words] and return its version
+    uint32_t read(uint64_t *out) const {
+        for (;;) {
+            uint32_t before = seq_.load(std::memory_order_acquire);
+            if (before & 1) continue;       // Write in progress, a few stores at most
+            for (size_t i = 0; i < Words; i++) {
+                out[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == before) return before;
+        }
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> seq_{0};
+    alignas(64) std::atomic<uint64_t> words_[Words] = {};
+};
+
+#endif // SEQLOCK_H
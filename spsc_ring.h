@@ -0,0 +1,57 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring.
+// push() is only ever called from one thread and pop() from one other thread;
+// neither side ever blocks or allocates. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+public:
+    // Returns false (and drops the item) when the ring is full
+    bool push(const T &item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == Capacity) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ == Capacity) return false;
+        }
+        slots_[head & (Capacity - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when there is nothing to read
+    bool pop(T &item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) return false;
+        }
+        item = slots_[tail & (Capacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from outside producer/consumer
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    // Producer and consumer indices live on separate cache lines so the two
+    // threads don't keep stealing the same line from each other
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;     // producer's last view of tail_
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;     // consumer's last view of head_
+    alignas(64) T slots_[Capacity];
+};
+
+#endif // SPSC_RING_H
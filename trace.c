@@ -0,0 +1,150 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} TraceZone;
+
+// Each ring has exactly one writer, the thread that claimed it. head counts
+// every zone ever recorded; the dump copies behind it and then drops whatever
+// the writer may have overwritten while the copy was running.
+typedef struct {
+    TraceZone *zones;
+    atomic_size_t head;
+    _Atomic(const char *) name;
+} TraceRing;
+
+volatile int trace_on = 0;
+
+static TraceRing rings[TRACE_MAX_THREADS];
+static atomic_int rings_claimed;
+static atomic_uint threads_dropped;     // Threads that found every ring taken
+static uint64_t trace_epoch_ns;
+
+static TRACE_THREAD_LOCAL TraceRing *thread_ring = NULL;
+static TRACE_THREAD_LOCAL int thread_untraced = 0;
+
+int trace_start(void) {
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        rings[i].zones = (TraceZone *)calloc(TRACE_RING_ZONES, sizeof(TraceZone));
+        if (!rings[i].zones) {
+            for (int j = 0; j < i; j++) {
+                free(rings[j].zones);
+                rings[j].zones = NULL;
+            }
+            printf("Error: Not enough memory for the trace buffers\n");
+            return 0;
+        }
+        atomic_init(&rings[i].head, 0);
+        atomic_init(&rings[i].name, NULL);
+    }
+    atomic_init(&rings_claimed, 0);
+    atomic_init(&threads_dropped, 0);
+    trace_epoch_ns = platform_time_ns();
+    trace_on = 1;
+    return 1;
+}
+
+// First zone (or name) from this thread: take the next free ring
+static TraceRing *claim_ring(void) {
+    if (thread_ring || thread_untraced) return thread_ring;
+    int index = atomic_fetch_add(&rings_claimed, 1);
+    if (index >= TRACE_MAX_THREADS) {
+        atomic_fetch_add(&threads_dropped, 1);
+        thread_untraced = 1;
+        return NULL;
+    }
+    thread_ring = &rings[index];
+    return thread_ring;
+}
+
+void trace_thread_name(const char *name) {
+    if (!trace_on) return;
+    TraceRing *ring = claim_ring();
+    if (ring) atomic_store_explicit(&ring->name, name, memory_order_release);
+}
+
+void trace_zone(const char *name, uint64_t start_ns, uint64_t end_ns) {
+    TraceRing *ring = claim_ring();
+    if (!ring) return;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceZone *zone = &ring->zones[head & (TRACE_RING_ZONES - 1)];
+    zone->name = name;
+    zone->start_ns = start_ns;
+    zone->end_ns = end_ns;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Microseconds since trace_start(), which is what the viewers expect
+static double trace_us(uint64_t ns) {
+    return ns > trace_epoch_ns ? (ns - trace_epoch_ns) / 1000.0 : 0.0;
+}
+
+int trace_write(const char *path) {
+    if (!rings[0].zones) return 0;
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Error: Could not create %s\n", path);
+        return -1;
+    }
+    TraceZone *copy = (TraceZone *)malloc(TRACE_RING_ZONES * sizeof(TraceZone));
+    if (!copy) {
+        fclose(file);
+        return -1;
+    }
+
+    int claimed = atomic_load(&rings_claimed);
+    if (claimed > TRACE_MAX_THREADS) claimed = TRACE_MAX_THREADS;
+
+    int written = 0;
+    int first = 1;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int tid = 0; tid < claimed; tid++) {
+        TraceRing *ring = &rings[tid];
+
+        const char *name = atomic_load_explicit(&ring->name, memory_order_acquire);
+        char fallback[32];
+        if (!name) {
+            snprintf(fallback, sizeof(fallback), "thread %d", tid);
+            name = fallback;
+        }
+        fprintf(file, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", tid, name);
+        first = 0;
+
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        size_t from = head > TRACE_RING_ZONES ? head - TRACE_RING_ZONES : 0;
+        for (size_t i = from; i < head; i++) {
+            copy[i & (TRACE_RING_ZONES - 1)] = ring->zones[i & (TRACE_RING_ZONES - 1)];
+        }
+        // Zones the writer got to during the copy replaced the oldest ones
+        atomic_thread_fence(memory_order_acquire);
+        size_t after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        if (after >= TRACE_RING_ZONES && after - TRACE_RING_ZONES + 1 > from) {
+            from = after - TRACE_RING_ZONES + 1;
+        }
+
+        for (size_t i = from; i < head; i++) {
+            const TraceZone *zone = &copy[i & (TRACE_RING_ZONES - 1)];
+            uint64_t end_ns = zone->end_ns > zone->start_ns ? zone->end_ns : zone->start_ns;
+            fprintf(file, ",\n{\"ph\": \"X\", \"name\": \"%s\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    zone->name, tid, trace_us(zone->start_ns), (end_ns - zone->start_ns) / 1000.0);
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    free(copy);
+
+    unsigned dropped = atomic_load(&threads_dropped);
+    printf("Trace: %d zones from %d threads written to %s", written, claimed, path);
+    if (dropped) printf(" (%u more threads not traced)", dropped);
+    printf("\n");
+    return written;
+}
@@ -0,0 +1,61 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timeline tracing: named zones (start/end on the host clock) recorded into
+// one ring per thread and written out as Chrome trace-event JSON, which opens
+// in chrome://tracing or ui.perfetto.dev. A thread never waits or allocates to
+// record a zone; when a ring wraps, its oldest zones are overwritten.
+// While tracing is off each zone costs one predictable branch on trace_on.
+
+#define TRACE_MAX_THREADS 16
+#define TRACE_RING_ZONES 65536          // Per thread, must be a power of two
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#elif defined(__cplusplus)
+#define TRACE_THREAD_LOCAL thread_local
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+extern volatile int trace_on;
+
+// Allocate the rings and start recording. Returns 0 if out of memory.
+int trace_start(void);
+
+// Label the calling thread in the viewer. Unnamed threads show as "thread N".
+void trace_thread_name(const char *name);
+
+// Record a finished zone. name must outlive the trace (a string literal).
+void trace_zone(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+// Write everything recorded so far. Safe while other threads keep recording.
+// Returns the number of zones written, or -1 if the file can't be created.
+int trace_write(const char *path);
+
+// TRACE_ZONE("zone", statement) or TRACE_ZONE("zone", { block }).
+// The statement is expanded once per branch, so whichever way trace_on
+// goes it is the only test. No break, continue or return at its top level.
+#define TRACE_ZONE(name, ...) \
+    do { \
+        if (trace_on) { \
+            uint64_t trace_zone_start_ = platform_time_ns(); \
+            __VA_ARGS__; \
+            trace_zone(name, trace_zone_start_, platform_time_ns()); \
+        } else { \
+            __VA_ARGS__; \
+        } \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACE_H
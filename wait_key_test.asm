@@ -0,0 +1,40 @@
+; Checks that WAIT_KEY_TIMEOUT limits the whole WAIT_KEY read, even when
+; key releases wake the wait in between. Run it headless with its script:
+;
+;   piano wait_key_test.bin --script wait_key_test.keys
+;
+; q goes down at 10 ms and up at 50 ms, w goes down at 130 ms. The second
+; read starts right after q (10 ms) and must time out at 110 ms, before w
+; arrives. The bus stats at exit show the result: one PLAY_FREQUENCY write
+; means pass, a PLAY_WAV_ID write means fail.
+
+.const PLAY_FREQUENCY 0x9001
+.const PLAY_WAV_ID 0x9002
+.const WAIT_KEY 0x9011
+.const WAIT_KEY_TIMEOUT 0x9012
+
+!main
+    set rA, 100
+    str [WAIT_KEY_TIMEOUT], rA
+
+    lod rA, [WAIT_KEY]      ; q at 10 ms
+    cmp rA, 113
+    jne !fail
+
+    lod rA, [WAIT_KEY]      ; Woken by q's release, still times out at 110 ms
+    cmp rA, 0
+    jne !fail
+
+    lod rA, [WAIT_KEY]      ; w at 130 ms
+    cmp rA, 119
+    jne !fail
+
+    set rC, 880
+    str [PLAY_FREQUENCY], rC
+    jmp !done
+
+!fail
+    str [PLAY_WAV_ID], rZ
+
+!done
+    jmp !done